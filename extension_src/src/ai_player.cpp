@@ -1,82 +1,131 @@
 #include "ai_player.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 #include <algorithm>
+#include <functional>
 #include <godot_cpp/classes/time.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
 #include <vector>
 
 using namespace godot;
+using namespace EvalParams;
 
-std::vector<Shogi::Move> AIPlayer::get_legal_moves(const BoardState &board, int side) {
-    std::vector<Shogi::Move> moves;
-    bool is_enemy_turn = (side == Shogi::ENEMY);
+namespace {
 
-    for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
-        for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
-            const Cell &cell = board.get_cell(col, row);
-
-            // 自駒でないならスキップ
-            if (cell.is_empty() || cell.side != side) {
-                continue;
-            }
+// 探索中の手順を局面履歴に積み、抜けるときに取り除く
+struct HistoryScope {
+    PositionHistory &history;
 
-            for (int t_col = 0; t_col < Shogi::BOARD_COLS; ++t_col) {
-                for (int t_row = 0; t_row < Shogi::BOARD_ROWS; ++t_row) {
-                    if (board.is_legal_move(col, row, t_col, t_row)) {
-                        bool is_capture = !board.get_cell(t_col, t_row).is_empty();
-                        bool can_promote = false;
-                        bool must_promote = false;
-
-                        if (!cell.is_promoted && cell.type != Shogi::KING && cell.type != Shogi::GOLD) {
-                            int zone_min = is_enemy_turn ? 6 : 0;
-                            int zone_max = is_enemy_turn ? 8 : 2;
-                            bool from_in_zone = (row >= zone_min && row <= zone_max);
-                            bool to_in_zone = (t_row >= zone_min && t_row <= zone_max);
-
-                            if (from_in_zone || to_in_zone) {
-                                can_promote = true;
-                            }
-                        }
-
-                        if (board.is_dead_end(cell.type, is_enemy_turn, t_row)) {
-                            must_promote = true;
-                        }
-
-                        if (!must_promote) {
-                            moves.emplace_back(col, row, t_col, t_row, cell.type, false, false, is_capture);
-                        }
-
-                        if (can_promote) {
-                            moves.emplace_back(col, row, t_col, t_row, cell.type, true, false, is_capture);
-                        }
-                    }
-                }
-            }
+    HistoryScope(PositionHistory &p_history, uint64_t key, bool in_check) : history(p_history) {
+        history.push(key, in_check);
+    }
+    ~HistoryScope() { history.pop(); }
+};
+
+// 評価値の高い順に並べる（同点は元の順）。std::stable_sort と違って作業領域を確保しない
+void sort_root_moves(std::vector<AIPlayer::RootMove> &root_moves) {
+    for (size_t i = 1; i < root_moves.size(); ++i) {
+        AIPlayer::RootMove root_move = root_moves[i];
+        size_t j = i;
+        for (; j > 0 && root_moves[j - 1].score < root_move.score; --j) {
+            root_moves[j] = root_moves[j - 1];
         }
+        root_moves[j] = root_move;
     }
+}
 
-    for (int piece_type = 0; piece_type < Shogi::PIECE_TYPE_COUNT; ++piece_type) {
-        if (board.get_hand_count(side, piece_type) > 0) {
-            for (int t_col = 0; t_col < Shogi::BOARD_COLS; ++t_col) {
-                for (int t_row = 0; t_row < Shogi::BOARD_ROWS; ++t_row) {
-                    if (board.is_legal_drop(piece_type, is_enemy_turn, t_col, t_row)) {
-                        moves.emplace_back(0, 0, t_col, t_row, piece_type, false, true, false);
-                    }
-                }
+// 取る手を先に、それぞれ生成順にルートの手を並べる
+void append_root_moves(const std::vector<Shogi::Move> &moves, std::vector<AIPlayer::RootMove> &root_moves) {
+    for (int captures = 1; captures >= 0; --captures) {
+        for (const Shogi::Move &move : moves) {
+            if (move.is_capture == (captures == 1)) {
+                AIPlayer::RootMove root_move;
+                root_move.move = move;
+                root_move.index = static_cast<int>(root_moves.size());
+                root_moves.push_back(root_move);
             }
         }
     }
+}
+
+} // namespace
+
+AIPlayer::AIPlayer(bool p_is_enemy_side, const PositionHistory &p_history, TranspositionTable &p_tt)
+    : is_enemy_side(p_is_enemy_side), history(p_history), tt(p_tt), eval_cache(EVAL_CACHE_KB) {
+    limits.time_usec = TIME_LIMIT_USEC;
 
+    // 探索中も使い回したときも確保し直さないよう、履歴とルートの手の領域をここで取る
+    history.reserve(std::max(history.size(), GAME_PLY_RESERVE) + SearchStack::MAX_PLY + 1);
+    root_legal_moves.reserve(SearchStack::MAX_MOVES);
+    root_search.root_moves.reserve(SearchStack::MAX_ROOT_MOVES);
+    root_search.ordered.reserve(SearchStack::MAX_ROOT_MOVES);
+    root_search.top_scores.reserve(SearchStack::MAX_ROOT_MOVES + 1);
+}
+
+void AIPlayer::reset(bool p_is_enemy_side, const PositionHistory &p_history) {
+    is_enemy_side = p_is_enemy_side;
+    history = p_history;
+    history.reserve(history.size() + SearchStack::MAX_PLY + 1);
+
+    limits = SearchLimits();
+    limits.time_usec = TIME_LIMIT_USEC;
+    nodes = 0;
+    time_up = false;
+    verbose = true;
+    declare_win = false;
+    root_split_threads = 0;
+    experience.reset();
+    root_search.finished = true;
+}
+
+std::vector<Shogi::Move> AIPlayer::get_legal_moves(const BoardState &board, int side) {
+    std::vector<Shogi::Move> moves;
+    moves.reserve(128);
+    board.generate_legal_moves(side, moves);
     return moves;
 }
 
-int AIPlayer::evaluate(const BoardState &board) {
+void AIPlayer::set_network(std::shared_ptr<const NNUE::Network> p_network) {
+    // 使い回すときに同じネットワークなら作り直さない
+    if (p_network == network) {
+        return;
+    }
+    eval_cache.clear();
+    network = std::move(p_network);
+    if (network) {
+        accumulators.reset(new NNUE::AccumulatorStack(network));
+    } else {
+        accumulators.reset();
+    }
+}
+
+int AIPlayer::evaluate(const BoardState &board, int side) {
+    int my_side = is_enemy_side ? Shogi::ENEMY : Shogi::PLAYER;
+    uint64_t key = board.get_key(side);
+
+    // キャッシュには手番側から見た値を置く
+    int score;
+    if (!eval_cache.probe(key, score)) {
+        if (accumulators) {
+            score = accumulators->evaluate(board, side);
+        } else {
+            int material = evaluate_material(board);
+            score = (side == my_side) ? material : -material;
+        }
+        eval_cache.store(key, score);
+    }
+
+    return (side == my_side) ? score : -score;
+}
+
+int AIPlayer::evaluate_material(const BoardState &board) {
     int score = 0;
     int my_side = is_enemy_side ? Shogi::ENEMY : Shogi::PLAYER;
 
     // 盤上の駒
     for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
         for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
-            const Cell &cell = board.get_cell(col, row);
+            Cell cell = board.get_cell(col, row);
             if (cell.is_empty()) {
                 continue;
             }
@@ -131,183 +180,659 @@ int AIPlayer::evaluate(const BoardState &board) {
         score += board.get_hand_count(side, Shogi::ROOK) * VAL_ROOK * sign;
     }
 
+    // 入玉: 玉が敵陣へ進むほど、敵陣に入ってからは宣言の点数が増えるほど加点する
+    for (int side = 0; side < 2; ++side) {
+        int sign = (side == my_side) ? 1 : -1;
+        score += board.get_king_advance(side) * ENTERING_KING_STEP * sign;
+        if (board.is_king_in_enemy_camp(side)) {
+            score += board.get_impasse_points(side) * DECLARE_POINT_BONUS * sign;
+        }
+    }
+
+    // 玉の安全度: 王手している駒やピンされている駒の数で加減する
+    for (int side = 0; side < 2; ++side) {
+        int sign = (side == my_side) ? 1 : -1;
+        BoardState::KingDanger danger;
+        board.get_king_danger(side, danger);
+        score += (danger.checker_count * KING_CHECKER + danger.pin_count * KING_PINNED_PIECE) * sign;
+    }
+
     return score;
 }
 
-int AIPlayer::alpha_beta(BoardState board, int depth, int alpha, int beta, int side, uint64_t end_time, bool &timeout) {
-    if (Time::get_singleton()->get_ticks_usec() > end_time) {
+int AIPlayer::alpha_beta(BoardState board, int depth, int ply, int alpha, int beta, int side, uint64_t end_time,
+                         bool &timeout) {
+    if (is_search_exhausted(end_time)) {
         timeout = true;
         return 0;
     }
 
-    if (depth == 0) {
-        return evaluate(board);
+    ++nodes;
+
+    SearchStack::Frame &frame = stack->at(ply);
+    frame.pv_length = 0;
+
+    uint64_t key = board.get_key(side);
+    HistoryScope history_scope(history, key, board.is_king_in_check(side));
+
+    // 千日手になる手順はそれ以上読まない
+    PositionHistory::Repetition repetition = history.check_repetition();
+    if (repetition != PositionHistory::REPETITION_NONE) {
+        return repetition_score(repetition, side);
     }
 
-    std::vector<Shogi::Move> moves = get_legal_moves(board, side);
     int my_side = is_enemy_side ? Shogi::ENEMY : Shogi::PLAYER;
 
+    // 入玉宣言できる局面は手番側の勝ち
+    if (board.can_declare_win(side)) {
+        return (side == my_side) ? 999999 : -999999;
+    }
+
+    if (depth == 0) {
+        frame.static_eval = evaluate(board, side);
+        return frame.static_eval;
+    }
+
+    int alpha_orig = alpha;
+    int beta_orig = beta;
+
+    // 置換表を引く（保存値は手番側から見た値なので自分視点に直す）
+    uint16_t tt_move = 0;
+    TranspositionTable::Entry entry;
+    bool found = tt.probe(key, entry);
+    if (!found && experience && experience->probe(key, entry)) {
+        // 置換表に写しておき、同じ探索で何度も二分探索しない
+        tt.store(key, entry.score, entry.bound(), entry.depth, entry.move);
+        found = true;
+    }
+    if (found) {
+        tt_move = entry.move;
+        if (entry.depth >= depth) {
+            int tt_score = (side == my_side) ? entry.score : -entry.score;
+            TranspositionTable::Bound bound = entry.bound();
+            if (side != my_side && bound != TranspositionTable::BOUND_EXACT) {
+                bound = (bound == TranspositionTable::BOUND_LOWER) ? TranspositionTable::BOUND_UPPER
+                                                                   : TranspositionTable::BOUND_LOWER;
+            }
+
+            if (bound == TranspositionTable::BOUND_EXACT ||
+                (bound == TranspositionTable::BOUND_LOWER && tt_score >= beta) ||
+                (bound == TranspositionTable::BOUND_UPPER && tt_score <= alpha)) {
+                return tt_score;
+            }
+        }
+    }
+
+    // 指し手はフレームの領域に生成する（探索中に確保し直さない）
+    std::vector<Shogi::Move> &moves = frame.moves;
+    board.generate_legal_moves(side, moves);
+
     if (moves.empty()) {
         // 投了
         return (side == my_side) ? -999999 : 999999;
     }
 
-    // 取る手を優先
+    // 取る手を優先し、その次にキラー手
     std::sort(moves.begin(), moves.end(),
               [](const Shogi::Move &a, const Shogi::Move &b) { return a.is_capture > b.is_capture; });
+    auto quiet_begin = std::find_if(moves.begin(), moves.end(), [](const Shogi::Move &m) { return !m.is_capture; });
+    for (int i = 1; i >= 0; --i) {
+        uint16_t killer = Shogi::encode_move(frame.killers[i]);
+        if (killer == 0) {
+            continue;
+        }
+        auto it = std::find_if(quiet_begin, moves.end(),
+                               [&](const Shogi::Move &m) { return Shogi::encode_move(m) == killer; });
+        if (it != moves.end()) {
+            std::rotate(quiet_begin, it, it + 1);
+        }
+    }
 
-    int next_side = (side == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+    // 置換表の手を最優先
+    if (tt_move != 0) {
+        auto it = std::find_if(moves.begin(), moves.end(),
+                               [&](const Shogi::Move &m) { return Shogi::encode_move(m) == tt_move; });
+        if (it != moves.end()) {
+            std::rotate(moves.begin(), it, it + 1);
+        }
+    }
+
+    int best_eval;
+    uint16_t best_move = 0;
 
     if (side == my_side) {
         int max_eval = -99999999;
         for (const Shogi::Move &move : moves) {
-            BoardState next_board = board;
-            next_board.apply_move(move, side);
-            int eval = alpha_beta(next_board, depth - 1, alpha, beta, next_side, end_time, timeout);
+            frame.current_move = move;
+            int eval = search_move(board, move, depth, ply, alpha, beta, side, end_time, timeout);
             if (timeout) {
                 return 0;
             }
 
-            max_eval = std::max(max_eval, eval);
-            alpha = std::max(alpha, eval);
+            if (eval > max_eval) {
+                max_eval = eval;
+                best_move = Shogi::encode_move(move);
+            }
+            if (eval > alpha) {
+                alpha = eval;
+                update_pv(ply, move);
+            }
             if (beta <= alpha) {
+                store_killer(ply, move);
                 break; // βカット
             }
         }
 
-        return max_eval;
+        best_eval = max_eval;
     } else {
         int min_eval = 99999999;
         for (const Shogi::Move &move : moves) {
-            BoardState next_board = board;
-            next_board.apply_move(move, side);
-            int eval = alpha_beta(next_board, depth - 1, alpha, beta, next_side, end_time, timeout);
+            frame.current_move = move;
+            int eval = search_move(board, move, depth, ply, alpha, beta, side, end_time, timeout);
             if (timeout) {
                 return 0;
             }
 
-            min_eval = std::min(min_eval, eval);
-            beta = std::min(beta, eval);
+            if (eval < min_eval) {
+                min_eval = eval;
+                best_move = Shogi::encode_move(move);
+            }
+            if (eval < beta) {
+                beta = eval;
+                update_pv(ply, move);
+            }
             if (beta <= alpha) {
+                store_killer(ply, move);
                 break; // αカット
             }
         }
 
-        return min_eval;
+        best_eval = min_eval;
+    }
+
+    // 自分視点で境界を決めてから、手番側視点に直して保存する
+    TranspositionTable::Bound bound = TranspositionTable::BOUND_EXACT;
+    if (best_eval <= alpha_orig) {
+        bound = TranspositionTable::BOUND_UPPER;
+    } else if (best_eval >= beta_orig) {
+        bound = TranspositionTable::BOUND_LOWER;
+    }
+
+    int tt_score = best_eval;
+    if (side != my_side) {
+        tt_score = -best_eval;
+        if (bound != TranspositionTable::BOUND_EXACT) {
+            bound = (bound == TranspositionTable::BOUND_LOWER) ? TranspositionTable::BOUND_UPPER
+                                                               : TranspositionTable::BOUND_LOWER;
+        }
+    }
+    tt.store(key, tt_score, bound, depth, best_move);
+
+    return best_eval;
+}
+
+int AIPlayer::search_move(const BoardState &board, const Shogi::Move &move, int depth, int ply, int alpha, int beta,
+                          int side, uint64_t end_time, bool &timeout) {
+    BoardState next_board = board;
+    next_board.apply_move(move, side);
+
+    if (accumulators) {
+        accumulators->push(board, move, side);
+    }
+
+    int next_side = (side == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+    int eval = alpha_beta(next_board, depth - 1, ply + 1, alpha, beta, next_side, end_time, timeout);
+
+    if (accumulators) {
+        accumulators->pop();
+    }
+
+    return eval;
+}
+
+int AIPlayer::search_root_move(const BoardState &board, const Shogi::Move &move, int depth, int alpha, bool &timeout) {
+    int my_side = is_enemy_side ? Shogi::ENEMY : Shogi::PLAYER;
+
+    if (accumulators) {
+        accumulators->reset(board);
+    }
+
+    // タスクごとに同じ状態から読む（キラー手を持ち越さない）
+    search_stack().reset();
+
+    return search_move(board, move, depth, 0, alpha, 99999999, my_side, UINT64_MAX, timeout);
+}
+
+void AIPlayer::reset_task(const SearchLimits &task_limits) {
+    set_limits(task_limits);
+    nodes = 0;
+    time_up = false;
+    eval_cache.clear();
+    tt.new_task();
+}
+
+SearchStack &AIPlayer::search_stack() {
+    if (!stack) {
+        owned_stack.reset(new SearchStack());
+        stack = owned_stack.get();
+    }
+    return *stack;
+}
+
+void AIPlayer::update_pv(int ply, const Shogi::Move &move) {
+    SearchStack::Frame &frame = stack->at(ply);
+    const SearchStack::Frame &child = stack->at(ply + 1);
+    frame.pv[0] = move;
+    std::copy(child.pv, child.pv + child.pv_length, frame.pv + 1);
+    frame.pv_length = child.pv_length + 1;
+}
+
+void AIPlayer::store_killer(int ply, const Shogi::Move &move) {
+    if (move.is_capture) {
+        return;
+    }
+
+    SearchStack::Frame &frame = stack->at(ply);
+    if (Shogi::encode_move(frame.killers[0]) != Shogi::encode_move(move)) {
+        frame.killers[1] = frame.killers[0];
+        frame.killers[0] = move;
+    }
+}
+
+void AIPlayer::copy_root_pv(RootMove &root_move, SearchStack &pv_stack) {
+    const SearchStack::Frame &child = stack->at(1);
+    int length = std::min(child.pv_length, SearchStack::MAX_PLY - 1);
+    Shogi::Move *pv = pv_stack.root_pv(root_move.index, root_move.depth);
+    pv[0] = root_move.move;
+    std::copy(child.pv, child.pv + length, pv + 1);
+    root_move.pv = pv;
+    root_move.pv_length = length + 1;
+}
+
+bool AIPlayer::is_search_exhausted(uint64_t end_time) {
+    if (limits.nodes > 0 && nodes >= limits.nodes) {
+        return true;
+    }
+
+    // 時刻の取得は（特にブラウザでは）重いので、一定ノードごとにだけ確かめる
+    if (time_up) {
+        return true;
+    }
+    if (end_time == UINT64_MAX || (nodes & (TIME_CHECK_INTERVAL - 1)) != 0) {
+        return false;
+    }
+
+    time_up = Time::get_singleton()->get_ticks_usec() > end_time;
+    return time_up;
+}
+
+int AIPlayer::repetition_score(PositionHistory::Repetition repetition, int side) const {
+    int my_side = is_enemy_side ? Shogi::ENEMY : Shogi::PLAYER;
+
+    switch (repetition) {
+    case PositionHistory::REPETITION_WIN:
+        return (side == my_side) ? 999999 : -999999;
+    case PositionHistory::REPETITION_LOSS:
+        return (side == my_side) ? -999999 : 999999;
+    default:
+        return 0;
     }
 }
 
 double AIPlayer::calculate_win_probability(int score) {
-    const double SCALING_FACTOR = 3333.0;
-    return 1.0 / (1.0 + std::pow(10.0, -static_cast<double>(score) / SCALING_FACTOR));
+    return 1.0 / (1.0 + std::pow(10.0, -static_cast<double>(score) / WIN_RATE_SCALE));
 }
 
-Dictionary AIPlayer::search_best_move(BoardState board) {
+Dictionary AIPlayer::move_to_dictionary(const Shogi::Move &move) {
+    Dictionary result;
+    result["from_col"] = move.from_col;
+    result["from_row"] = move.from_row;
+    result["to_col"] = move.to_col;
+    result["to_row"] = move.to_row;
+    result["piece_type"] = move.piece_type;
+    result["is_promotion"] = move.is_promotion;
+    result["is_drop"] = move.is_drop;
+    return result;
+}
+
+const std::vector<AIPlayer::RootMove> &AIPlayer::search_root(BoardState board, int multi_pv) {
+    begin_root(board, multi_pv);
+    step_root(0);
+    return finish_root();
+}
+
+void AIPlayer::begin_root(const BoardState &board, int multi_pv) {
     int my_side = is_enemy_side ? Shogi::ENEMY : Shogi::PLAYER;
-    std::vector<Shogi::Move> moves = get_legal_moves(board, my_side);
+    // 前の探索の領域を使い回す
+    RootSearch &rs = root_search;
+    rs.board = board;
+    rs.root_moves.clear();
+    rs.ordered.clear();
+    rs.top_scores.clear();
+    rs.multi_pv = 1;
+    rs.depth = 0;
+    rs.next = 0;
+    rs.used_usec = 0;
+    rs.finished = true;
+    search_stack().reset();
+
+    // 宣言で勝てるなら読まない
+    declare_win = board.can_declare_win(my_side);
+    if (declare_win) {
+        return;
+    }
 
-    if (moves.empty()) {
-        // 投了
-        Dictionary result;
-        result["win_rate"] = 0.0;
-        return result;
+    board.generate_legal_moves(my_side, root_legal_moves);
+    if (root_legal_moves.empty()) {
+        return;
     }
 
-    uint64_t start_time = Time::get_singleton()->get_ticks_usec();
-    uint64_t end_time = start_time + TIME_LIMIT_USEC;
+    // 探索開始局面を履歴の末尾に置く
+    if (history.top_key() != board.get_key(my_side)) {
+        history.push(board.get_key(my_side), board.is_king_in_check(my_side));
+    }
 
-    int max_depth_limit = 10;
+    tt.new_search();
 
-    Shogi::Move global_best_move = moves[0];
-    int global_best_score = -99999999;
+    if (accumulators) {
+        accumulators->reset(board);
+    }
 
-    Shogi::Move best_move_prev_iter = moves[0];
-    bool has_prev_best = false;
+    // 取る手を優先
+    append_root_moves(root_legal_moves, rs.root_moves);
 
-    for (int depth = 1; depth <= max_depth_limit; ++depth) {
-        bool timeout = false;
-        if (Time::get_singleton()->get_ticks_usec() > end_time) {
-            UtilityFunctions::print("Time limit reached before depth ", depth);
+    rs.multi_pv = std::max(1, std::min(multi_pv, static_cast<int>(rs.root_moves.size())));
+    rs.finished = false;
+    start_root_iteration();
+}
+
+void AIPlayer::start_root_iteration() {
+    RootSearch &rs = root_search;
+    ++rs.depth;
+    if (rs.depth > limits.depth) {
+        rs.finished = true;
+        return;
+    }
+    SHOGI_TRACE_INSTANT("iteration start", rs.depth);
+
+    // 前の反復で良かった手から読む
+    rs.ordered = rs.root_moves;
+    sort_root_moves(rs.ordered);
+    rs.top_scores.clear();
+    rs.next = 0;
+}
+
+bool AIPlayer::step_root(uint64_t slice_usec) {
+    RootSearch &rs = root_search;
+    if (rs.finished) {
+        return true;
+    }
+    SHOGI_TRACE_SCOPE("step_root", static_cast<int64_t>(slice_usec));
+
+    int my_side = is_enemy_side ? Shogi::ENEMY : Shogi::PLAYER;
+
+    // 思考時間は区切りをまたいで通算する
+    uint64_t start_time = Time::get_singleton()->get_ticks_usec();
+    uint64_t end_time = UINT64_MAX;
+    if (limits.time_usec > 0) {
+        end_time = start_time + ((limits.time_usec > rs.used_usec) ? limits.time_usec - rs.used_usec : 0);
+    }
+    uint64_t slice_end = (slice_usec > 0) ? std::min(end_time, start_time + slice_usec) : end_time;
+
+    auto is_exhausted = [&]() {
+        return (limits.nodes > 0 && nodes >= limits.nodes) || Time::get_singleton()->get_ticks_usec() > end_time;
+    };
+
+    time_up = false;
+    bool searched = false;
+
+    while (!rs.finished) {
+        if (is_exhausted()) {
+            if (verbose) {
+                UtilityFunctions::print("Time limit reached before depth ", rs.depth);
+            }
+            rs.finished = true;
             break;
         }
 
-        if (has_prev_best) {
-            auto it = std::find_if(moves.begin(), moves.end(), [&](const Shogi::Move &m) {
-                return m.from_col == best_move_prev_iter.from_col && m.from_row == best_move_prev_iter.from_row &&
-                       m.to_col == best_move_prev_iter.to_col && m.to_row == best_move_prev_iter.to_row &&
-                       m.piece_type == best_move_prev_iter.piece_type &&
-                       m.is_promotion == best_move_prev_iter.is_promotion && m.is_drop == best_move_prev_iter.is_drop;
-            });
-            if (it != moves.end()) {
-                std::rotate(moves.begin(), it, it + 1);
-            }
-        } else {
-            std::sort(moves.begin(), moves.end(),
-                      [](const Shogi::Move &a, const Shogi::Move &b) { return a.is_capture > b.is_capture; });
+        // 1手は読んでから区切る
+        if (searched && Time::get_singleton()->get_ticks_usec() > slice_end) {
+            break;
         }
 
-        int alpha = -99999999;
+        // 上位 multi_pv 手の評価値を保持し、その最下位をαとする
+        RootMove &root_move = rs.ordered[rs.next];
+        int alpha = (static_cast<int>(rs.top_scores.size()) < rs.multi_pv) ? -99999999 : rs.top_scores.back();
         int beta = 99999999;
-        Shogi::Move current_depth_best_move = moves[0];
-        int current_depth_best_score = -99999999;
-        int next_turn_side = (my_side == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
 
-        for (const auto &move : moves) {
-            if (Time::get_singleton()->get_ticks_usec() > end_time) {
-                timeout = true;
-                break;
+        bool timeout = false;
+        int score;
+        {
+            SHOGI_TRACE_SCOPE("root move", Shogi::encode_move(root_move.move));
+            score = search_move(rs.board, root_move.move, rs.depth, 0, alpha, beta, my_side, slice_end, timeout);
+        }
+        searched = true;
+        if (timeout) {
+            // 区切りの時間切れなら、この手は次の呼び出しで読み直す
+            continue;
+        }
+
+        root_move.score = score;
+        root_move.depth = rs.depth;
+        if (score > alpha) {
+            copy_root_pv(root_move, *stack);
+        }
+
+        rs.top_scores.insert(std::upper_bound(rs.top_scores.begin(), rs.top_scores.end(), score, std::greater<int>()),
+                             score);
+        if (static_cast<int>(rs.top_scores.size()) > rs.multi_pv) {
+            rs.top_scores.pop_back();
+        }
+
+        if (++rs.next < rs.ordered.size()) {
+            continue;
+        }
+
+        // 反復が終わった
+        SHOGI_TRACE_INSTANT("iteration end", rs.depth);
+        sort_root_moves(rs.ordered);
+        rs.root_moves = rs.ordered;
+
+        int best_score = rs.root_moves[0].score;
+        if (verbose) {
+            double win_prob = calculate_win_probability(best_score);
+            UtilityFunctions::print("Depth ", rs.depth, " completed. BestScore: ", best_score,
+                                    ", WinRate: ", String::num(win_prob * 100.0, 1), "%");
+        }
+
+        // 詰み筋を見つけたら打ち切り
+        if (best_score >= 999999 || best_score <= -999999) {
+            if (verbose) {
+                UtilityFunctions::print("Checkmate found at depth ", rs.depth);
             }
+            rs.finished = true;
+            break;
+        }
 
-            BoardState next_board = board;
-            next_board.apply_move(move, my_side);
+        start_root_iteration();
+    }
 
-            int score = alpha_beta(next_board, depth - 1, alpha, beta, next_turn_side, end_time, timeout);
-            if (timeout) {
+    rs.used_usec += Time::get_singleton()->get_ticks_usec() - start_time;
+    return rs.finished;
+}
+
+const std::vector<AIPlayer::RootMove> &AIPlayer::finish_root() {
+    root_search.finished = true;
+    std::vector<RootMove> &root_moves = root_search.root_moves;
+    if (!root_moves.empty()) {
+        root_moves.resize(root_search.multi_pv);
+    }
+    return root_moves;
+}
+
+std::vector<AIPlayer::RootMove> AIPlayer::search_root_split(BoardState board, int thread_count) {
+    int my_side = is_enemy_side ? Shogi::ENEMY : Shogi::PLAYER;
+    std::vector<Shogi::Move> moves = get_legal_moves(board, my_side);
+    std::vector<RootMove> root_moves;
+
+    declare_win = board.can_declare_win(my_side);
+    if (declare_win || moves.empty()) {
+        return root_moves;
+    }
+
+    if (history.top_key() != board.get_key(my_side)) {
+        history.push(board.get_key(my_side), board.is_king_in_check(my_side));
+    }
+
+    append_root_moves(moves, root_moves);
+
+    ThreadPool pool(thread_count);
+    // 読み筋はワーカーの作業領域からこの探索器の作業領域へ写す
+    SearchStack &pv_stack = search_stack();
+
+    // 置換表と作業領域と探索器はワーカーごとに作って使い回し、タスクの開始時に空にする
+    // （他のタスクの結果に左右されないように）
+    std::vector<std::unique_ptr<TranspositionTable>> tables;
+    std::vector<std::unique_ptr<SearchStack>> stacks;
+    std::vector<std::unique_ptr<AIPlayer>> players;
+    for (int i = 0; i < pool.get_thread_count(); ++i) {
+        tables.emplace_back(new TranspositionTable(ROOT_SPLIT_HASH_MB));
+        tables.back()->set_isolated(true);
+        stacks.emplace_back(new SearchStack());
+        players.emplace_back(new AIPlayer(is_enemy_side, history, *tables.back()));
+        players.back()->set_verbose(false);
+        players.back()->set_network(network);
+        players.back()->set_experience(experience);
+        players.back()->set_search_stack(stacks.back().get());
+    }
+
+    int count = static_cast<int>(root_moves.size());
+    uint64_t used_nodes = 0;
+
+    for (int depth = 1; depth <= limits.depth; ++depth) {
+        // 残りのノード数を手の数で割って各タスクの上限にする
+        uint64_t task_nodes = 0;
+        if (limits.nodes > 0) {
+            if (used_nodes >= limits.nodes) {
                 break;
             }
+            task_nodes = std::max<uint64_t>(1, (limits.nodes - used_nodes) / count);
+        }
 
-            if (score > current_depth_best_score) {
-                current_depth_best_score = score;
-                current_depth_best_move = move;
+        SHOGI_TRACE_SCOPE("split iteration", depth);
+        std::vector<RootMove> ordered = root_moves;
+        sort_root_moves(ordered);
+
+        std::vector<uint64_t> task_node_counts(count, 0);
+        std::vector<char> task_timeouts(count, 0);
+
+        auto search_task = [&](int index, int worker, int alpha) {
+            SHOGI_TRACE_SCOPE("root move", Shogi::encode_move(ordered[index].move));
+            AIPlayer &worker_player = *players[worker];
+            SearchLimits task_limits;
+            task_limits.nodes = task_nodes;
+            task_limits.depth = depth;
+            worker_player.reset_task(task_limits);
+
+            bool timeout = false;
+            RootMove &root_move = ordered[index];
+            int score = worker_player.search_root_move(board, root_move.move, depth, alpha, timeout);
+
+            task_node_counts[index] = worker_player.get_nodes();
+            task_timeouts[index] = timeout;
+            if (!timeout) {
+                root_move.score = score;
+                root_move.depth = depth;
+                worker_player.copy_root_pv(root_move, pv_stack);
             }
+        };
 
-            alpha = std::max(alpha, score);
+        // 前の反復の最善手を全幅で読み、その値をαとして残りの手を並列に読む
+        search_task(0, 0, -99999999);
+        if (!task_timeouts[0] && count > 1) {
+            int alpha = ordered[0].score;
+            pool.run(count - 1, [&](int task, int worker) { search_task(task + 1, worker, alpha); });
         }
 
-        if (timeout) {
-            UtilityFunctions::print("Time limit reached before depth ", depth);
-            break;
+        for (int i = 0; i < count; ++i) {
+            used_nodes += task_node_counts[i];
         }
+        nodes = used_nodes;
 
-        global_best_move = current_depth_best_move;
-        global_best_score = current_depth_best_score;
+        // どれかが打ち切られた反復は捨てる
+        if (std::find(task_timeouts.begin(), task_timeouts.end(), 1) != task_timeouts.end()) {
+            if (verbose) {
+                UtilityFunctions::print("Node limit reached before depth ", depth);
+            }
+            break;
+        }
 
-        best_move_prev_iter = global_best_move;
-        has_prev_best = true;
+        // 同点なら並び順の早い手を残す
+        sort_root_moves(ordered);
+        root_moves = ordered;
 
-        double win_prob = calculate_win_probability(global_best_score);
-        UtilityFunctions::print("Depth ", depth, " completed. BestScore: ", global_best_score,
-                                ", WinRate: ", String::num(win_prob * 100.0, 1), "%");
+        int best_score = root_moves[0].score;
+        if (verbose) {
+            double win_prob = calculate_win_probability(best_score);
+            UtilityFunctions::print("Depth ", depth, " completed. BestScore: ", best_score,
+                                    ", WinRate: ", String::num(win_prob * 100.0, 1), "%");
+        }
 
-        // 詰み筋を見つけたら打ち切り
-        if (global_best_score >= 999999 || global_best_score <= -999999) {
-            UtilityFunctions::print("Checkmate found at depth ", depth);
+        if (best_score >= 999999 || best_score <= -999999) {
+            if (verbose) {
+                UtilityFunctions::print("Checkmate found at depth ", depth);
+            }
             break;
         }
     }
 
-    const auto &best_move = global_best_move;
-    float win_rate = calculate_win_probability(global_best_score);
+    return root_moves;
+}
 
-    Dictionary result;
-    result["from_col"] = best_move.from_col;
-    result["from_row"] = best_move.from_row;
-    result["to_col"] = best_move.to_col;
-    result["to_row"] = best_move.to_row;
-    result["piece_type"] = best_move.piece_type;
-    result["is_promotion"] = best_move.is_promotion;
-    result["is_drop"] = best_move.is_drop;
-    result["win_rate"] = win_rate;
+Dictionary AIPlayer::search_best_move(BoardState board) {
+    std::vector<RootMove> split_moves;
+    if (root_split_threads > 0) {
+        split_moves = search_root_split(board, root_split_threads);
+    }
+    const std::vector<RootMove> &root_moves = (root_split_threads > 0) ? split_moves : search_root(board, 1);
+
+    if (root_moves.empty()) {
+        // 入玉宣言か投了
+        Dictionary result;
+        if (declare_win) {
+            result["declare_win"] = true;
+            result["win_rate"] = 1.0;
+        } else {
+            result["win_rate"] = 0.0;
+        }
+        return result;
+    }
+
+    const RootMove &best = root_moves[0];
+    Dictionary result = move_to_dictionary(best.move);
+    result["win_rate"] = static_cast<float>(calculate_win_probability(best.score));
+
+    return result;
+}
+
+Array AIPlayer::search_multi_pv(BoardState board, int multi_pv) {
+    const std::vector<RootMove> &root_moves = search_root(board, multi_pv);
+
+    Array result;
+    for (const RootMove &root_move : root_moves) {
+        Dictionary line = move_to_dictionary(root_move.move);
+        line["score"] = root_move.score;
+        line["depth"] = root_move.depth;
+        line["win_rate"] = static_cast<float>(calculate_win_probability(root_move.score));
+
+        Array pv;
+        for (int i = 0; i < root_move.pv_length; ++i) {
+            pv.append(move_to_dictionary(root_move.pv[i]));
+        }
+        line["pv"] = pv;
+
+        result.append(line);
+    }
 
     return result;
 }
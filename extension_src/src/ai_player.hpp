@@ -2,44 +2,146 @@
 #define AI_PLAYER_HPP
 
 #include "board_state.hpp"
+#include "eval_cache.hpp"
+#include "eval_params.hpp"
+#include "experience_store.hpp"
+#include "nnue_evaluator.hpp"
+#include "position_history.hpp"
+#include "search_stack.hpp"
 #include "shogi_engine.hpp"
+#include "transposition_table.hpp"
+#include <algorithm>
 #include <godot_cpp/classes/node2d.hpp>
 #include <godot_cpp/classes/ref_counted.hpp>
+#include <memory>
 
 namespace godot {
 
+// 探索の打ち切り条件（0 は無制限）
+struct SearchLimits {
+    uint64_t time_usec = 0;
+    uint64_t nodes = 0;
+    int depth = 10;
+};
+
 class AIPlayer {
+  public:
+    struct RootMove {
+        Shogi::Move move;
+        int score = -99999999;
+        int depth = 0;
+        int index = 0; // 生成した順番（読み筋の置き場所）
+        // 読み筋は探索スタックの中を指す（次の探索か、2つあとの反復で上書きされる）
+        const Shogi::Move *pv = nullptr;
+        int pv_length = 0;
+    };
 
   private:
     const uint64_t TIME_LIMIT_USEC = 1000000; // 1秒
+    const int EVAL_CACHE_KB = 64;             // L2に収まる大きさ
+    const int GAME_PLY_RESERVE = 1024;        // 局面履歴をあらかじめ確保する対局の手数
+    const int ROOT_SPLIT_HASH_MB = 1;         // ルート分割探索のワーカーごとの置換表（タスクごとに空にする）
+    const uint64_t TIME_CHECK_INTERVAL = 1024; // 時刻を確かめる間隔（ノード数、2のべき乗）
 
-    const int VAL_PAWN = 90;
-    const int VAL_LANCE = 230;
-    const int VAL_KNIGHT = 260;
-    const int VAL_SILVER = 370;
-    const int VAL_GOLD = 440;
-    const int VAL_BISHOP = 570;
-    const int VAL_ROOK = 640;
-    const int VAL_KING = 99999;
-    const int VAL_PRO_PAWN = 530;
-    const int VAL_PRO_LANCE = 490;
-    const int VAL_PRO_KNIGHT = 510;
-    const int VAL_PRO_SILVER = 500;
-    const int VAL_PRO_BISHOP = 830;
-    const int VAL_PRO_ROOK = 950;
+    // 少しずつ進められるルート探索の途中状態
+    struct RootSearch {
+        BoardState board;
+        std::vector<RootMove> root_moves; // 最後に読み終えた反復の結果
+        std::vector<RootMove> ordered;    // 読んでいる反復
+        std::vector<int> top_scores;
+        int multi_pv = 1;
+        int depth = 0;
+        size_t next = 0;        // ordered の次に読む手
+        uint64_t used_usec = 0; // これまでに使った思考時間
+        bool finished = true;
+    };
 
     bool is_enemy_side;
+    PositionHistory history;
+    TranspositionTable &tt;
+
+    SearchLimits limits;
+    uint64_t nodes = 0;
+    bool time_up = false;
+    bool verbose = true;
+    bool declare_win = false; // 最後のルート探索の局面で入玉宣言できた
+
+    RootSearch root_search;
+    std::vector<Shogi::Move> root_legal_moves; // begin_root で生成する合法手（最初に確保して使い回す）
+
+    // NNUE評価を使うときだけ作る
+    std::shared_ptr<const NNUE::Network> network;
+    std::unique_ptr<NNUE::AccumulatorStack> accumulators;
+
+    // 過去の対局の深い探索結果（置換表で見つからないときに引く）
+    std::shared_ptr<const ExperienceStore> experience;
+
+    // 0 より大きければルートの手をスレッドに分けて決定的に探索する
+    int root_split_threads = 0;
+
+    EvalCache eval_cache; // 探索スレッドごとに持つ
+
+    // 探索スレッドごとの作業領域（外から渡されなければ最初の探索で作る）
+    SearchStack *stack = nullptr;
+    std::unique_ptr<SearchStack> owned_stack;
 
     std::vector<Shogi::Move> get_legal_moves(const BoardState &board, int side);
-    int evaluate(const BoardState &board);
-    int alpha_beta(BoardState board, int depth, int alpha, int beta, int side, uint64_t end_time, bool &timeout);
-    double calculate_win_probability(int score);
+    int evaluate(const BoardState &board, int side);
+    int alpha_beta(BoardState board, int depth, int ply, int alpha, int beta, int side, uint64_t end_time,
+                   bool &timeout);
+    int search_move(const BoardState &board, const Shogi::Move &move, int depth, int ply, int alpha, int beta,
+                    int side, uint64_t end_time, bool &timeout);
+    SearchStack &search_stack();
+    void update_pv(int ply, const Shogi::Move &move);
+    void store_killer(int ply, const Shogi::Move &move);
+    // ルートの手を読んだ直後に、その手からの読み筋を pv_stack の置き場所に写す
+    void copy_root_pv(RootMove &root_move, SearchStack &pv_stack);
+    int search_root_move(const BoardState &board, const Shogi::Move &move, int depth, int alpha, bool &timeout);
+    // ルート分割のタスクを始める前に、前のタスクの結果が残らないようにする
+    void reset_task(const SearchLimits &task_limits);
+    bool is_search_exhausted(uint64_t end_time);
+    void start_root_iteration();
+    int repetition_score(PositionHistory::Repetition repetition, int side) const;
 
   public:
-    explicit AIPlayer(bool p_is_enemy_side) : is_enemy_side(p_is_enemy_side) {}
+    AIPlayer(bool p_is_enemy_side, const PositionHistory &p_history, TranspositionTable &p_tt);
     ~AIPlayer() {}
 
+    // 別の局面の探索に使い回す。置換表・評価のキャッシュ・NNUE・作業領域は引き継ぎ、
+    // 打ち切り条件などの設定は作ったときの状態に戻す
+    void reset(bool p_is_enemy_side, const PositionHistory &p_history);
+
+    void set_limits(const SearchLimits &p_limits) {
+        limits = p_limits;
+        limits.depth = std::min(limits.depth, SearchStack::MAX_PLY - 1);
+    }
+    void set_verbose(bool p_verbose) { verbose = p_verbose; }
+    void set_network(std::shared_ptr<const NNUE::Network> p_network);
+    void set_root_split_threads(int threads) { root_split_threads = threads; }
+    void set_experience(std::shared_ptr<const ExperienceStore> p_experience) { experience = std::move(p_experience); }
+    // 探索をまたいで使い回す作業領域（呼び出し側が寿命を持つ）
+    void set_search_stack(SearchStack *p_stack) { stack = p_stack; }
+    uint64_t get_nodes() const { return nodes; }
+    // ルート探索が手を返さなかったとき、投了ではなく入玉宣言か
+    bool is_declaring_win() const { return declare_win; }
+
+    // 結果は次にルート探索を始めるまで有効
+    const std::vector<RootMove> &search_root(BoardState board, int multi_pv);
+
+    // search_root を区切って進める。step_root は slice_usec（0 なら無制限）ほど読んで戻り、
+    // 探索が終わったら true を返す。区切りで途中になったルートの手は次の呼び出しで読み直す
+    void begin_root(const BoardState &board, int multi_pv);
+    bool step_root(uint64_t slice_usec);
+    const std::vector<RootMove> &finish_root();
+    // ルートの手を独立したタスクとして並列に読む。時間制限は見ず、同じノード数なら結果は常に同じ
+    std::vector<RootMove> search_root_split(BoardState board, int thread_count);
     Dictionary search_best_move(BoardState board);
+    Array search_multi_pv(BoardState board, int multi_pv);
+
+    static double calculate_win_probability(int score);
+    static Dictionary move_to_dictionary(const Shogi::Move &move);
+    // 駒得評価（自分視点、キャッシュを通さない）
+    int evaluate_material(const BoardState &board);
 };
 
 } // namespace godot
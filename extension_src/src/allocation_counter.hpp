@@ -0,0 +1,15 @@
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+#include <cstdint>
+
+// ヒープ確保の回数（SHOGI_COUNT_ALLOCATIONS を定義してビルドしたときだけ数える）
+// operator new を置き換えるので、計測用のビルドでだけ有効にする
+namespace AllocationCounter {
+
+bool is_enabled();
+uint64_t get();
+
+} // namespace AllocationCounter
+
+#endif
@@ -0,0 +1,252 @@
+#include "benchmark.hpp"
+#include "ai_player.hpp"
+#include "transposition_table.hpp"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace Benchmark {
+
+const char *const POSITIONS[POSITION_COUNT] = {
+    "startpos",
+    "lnsgkgsnl/1r7/p1ppp1bpp/1p3pp2/7P1/2P6/PP1PPPP1P/1B3S1R1/LNSGKG1NL b - 9",
+    "l4S2l/4g1gs1/5p1p1/pr2N1pkp/4Gn3/PP3PPPP/2GPP4/1K7/L3r+s2L w BS2N5Pb 1",
+    "6n1l/2+S1k4/2lp4p/1np1B2b1/3PP4/1N1S3rP/1P2+pPP+p1/1p1G5/3KG2r1 b GSN2L4Pgs2p 1",
+    "l6nl/5+P1gk/2np1S3/p1p4Pp/3P2Sp1/1PPb2P1P/P5GS1/R8/LN4bKL w RGgsn5p 1",
+};
+
+namespace {
+
+// 1回の計測で局面を何周するか（タイマーの分解能より十分長くする）
+const int BATCH_REPEAT = 16;
+
+// 結果を捨てられないように足し込む先
+volatile uint64_t sink = 0;
+
+struct Position {
+    BoardState board;
+    int side;
+    std::vector<Shogi::Move> moves;
+};
+
+double percentile(const std::vector<double> &sorted, double p) {
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// batch は1回分の処理をして操作の数を返す。1回目は温めるだけで数えない
+template <typename Batch> Dictionary measure(int samples, Batch batch) {
+    batch();
+
+    std::vector<double> ns_per_op;
+    ns_per_op.reserve(samples);
+    uint64_t ops = 0;
+    for (int i = 0; i < samples; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        ops = batch();
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        ns_per_op.push_back(ns / std::max<uint64_t>(1, ops));
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+
+    Dictionary stats;
+    stats["median_ns"] = percentile(ns_per_op, 0.5);
+    stats["p10_ns"] = percentile(ns_per_op, 0.1);
+    stats["p90_ns"] = percentile(ns_per_op, 0.9);
+    stats["p99_ns"] = percentile(ns_per_op, 0.99);
+    stats["min_ns"] = ns_per_op.front();
+    stats["ops_per_sample"] = static_cast<int64_t>(ops);
+    return stats;
+}
+
+uint64_t perft_recursive(const BoardState &board, int side, int depth, std::vector<std::vector<Shogi::Move>> &buffers) {
+    std::vector<Shogi::Move> &moves = buffers[depth];
+    board.generate_legal_moves(side, moves);
+
+    // 末端は数えるだけ
+    if (depth == 1) {
+        return moves.size();
+    }
+
+    int next_side = (side == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+    uint64_t nodes = 0;
+    for (const Shogi::Move &move : moves) {
+        BoardState next_state = board;
+        next_state.apply_move(move, side);
+        nodes += perft_recursive(next_state, next_side, depth - 1, buffers);
+    }
+    return nodes;
+}
+
+} // namespace
+
+uint64_t perft(const BoardState &board, int side, int depth) {
+    if (depth <= 0) {
+        return 1;
+    }
+
+    // 深さごとに指し手バッファを使い回す
+    std::vector<std::vector<Shogi::Move>> buffers(depth + 1);
+    for (std::vector<Shogi::Move> &buffer : buffers) {
+        buffer.reserve(128);
+    }
+    return perft_recursive(board, side, depth, buffers);
+}
+
+Dictionary microbench(int samples, Node *main_node) {
+    std::vector<Position> positions;
+    for (const char *sfen : POSITIONS) {
+        Position position;
+        if (!position.board.set_sfen(sfen, position.side)) {
+            continue;
+        }
+        position.board.generate_legal_moves(position.side, position.moves);
+        positions.push_back(position);
+    }
+
+    Dictionary primitives;
+
+    primitives["generate_legal_moves"] = measure(samples, [&]() {
+        std::vector<Shogi::Move> moves;
+        moves.reserve(SearchStack::MAX_MOVES);
+        uint64_t ops = 0;
+        for (int r = 0; r < BATCH_REPEAT; ++r) {
+            for (const Position &position : positions) {
+                position.board.generate_legal_moves(position.side, moves);
+                sink = sink + moves.size();
+                ++ops;
+            }
+        }
+        return ops;
+    });
+
+    // 探索と同じく盤面をコピーしてから指す
+    primitives["apply_move"] = measure(samples, [&]() {
+        uint64_t ops = 0;
+        for (int r = 0; r < BATCH_REPEAT; ++r) {
+            for (const Position &position : positions) {
+                for (const Shogi::Move &move : position.moves) {
+                    BoardState next = position.board;
+                    next.apply_move(move, position.side);
+                    sink = sink + next.get_key(position.side);
+                    ++ops;
+                }
+            }
+        }
+        return ops;
+    });
+
+    primitives["apply_undo_move"] = measure(samples, [&]() {
+        uint64_t ops = 0;
+        for (int r = 0; r < BATCH_REPEAT; ++r) {
+            for (Position &position : positions) {
+                for (const Shogi::Move &move : position.moves) {
+                    BoardState::UndoInfo undo;
+                    position.board.apply_move(move, position.side, undo);
+                    position.board.undo_move(move, position.side, undo);
+                    ++ops;
+                }
+            }
+        }
+        return ops;
+    });
+
+    primitives["is_legal_move"] = measure(samples, [&]() {
+        uint64_t ops = 0;
+        for (int r = 0; r < BATCH_REPEAT; ++r) {
+            for (const Position &position : positions) {
+                for (const Shogi::Move &move : position.moves) {
+                    if (move.is_drop) {
+                        continue;
+                    }
+                    sink = sink + position.board.is_legal_move(move.from_col, move.from_row, move.to_col, move.to_row);
+                    ++ops;
+                }
+            }
+        }
+        return ops;
+    });
+
+    primitives["is_king_in_check"] = measure(samples, [&]() {
+        uint64_t ops = 0;
+        for (int r = 0; r < BATCH_REPEAT * 16; ++r) {
+            for (const Position &position : positions) {
+                sink = sink + position.board.is_king_in_check(Shogi::PLAYER) +
+                       position.board.is_king_in_check(Shogi::ENEMY);
+                ops += 2;
+            }
+        }
+        return ops;
+    });
+
+    TranspositionTable tt(1);
+    AIPlayer ai_player(false, PositionHistory(), tt);
+    primitives["evaluate_material"] = measure(samples, [&]() {
+        uint64_t ops = 0;
+        for (int r = 0; r < BATCH_REPEAT * 16; ++r) {
+            for (const Position &position : positions) {
+                sink = sink + ai_player.evaluate_material(position.board);
+                ++ops;
+            }
+        }
+        return ops;
+    });
+
+    // search_best_move が結果を返すときの Dictionary の組み立て
+    primitives["move_to_dictionary"] = measure(samples, [&]() {
+        uint64_t ops = 0;
+        for (const Position &position : positions) {
+            for (const Shogi::Move &move : position.moves) {
+                Dictionary result = AIPlayer::move_to_dictionary(move);
+                result["win_rate"] = 0.5f;
+                sink = sink + result.size();
+                ++ops;
+            }
+        }
+        return ops;
+    });
+
+    if (main_node != nullptr) {
+        primitives["init_from_main"] = measure(samples, [&]() {
+            BoardState board;
+            board.init_from_main(main_node);
+            sink = sink + board.get_key(Shogi::PLAYER);
+            return static_cast<uint64_t>(1);
+        });
+
+        // Variant 経由のプロパティ読み出し1回分
+        std::vector<Object *> pieces;
+        Array board_grid = main_node->get("board_grid");
+        for (int col = 0; col < board_grid.size(); ++col) {
+            Array column = board_grid[col];
+            for (int row = 0; row < column.size(); ++row) {
+                Object *piece = Object::cast_to<Object>(column[row]);
+                if (piece != nullptr) {
+                    pieces.push_back(piece);
+                }
+            }
+        }
+        if (!pieces.empty()) {
+            primitives["variant_get_piece_type"] = measure(samples, [&]() {
+                uint64_t ops = 0;
+                for (int r = 0; r < BATCH_REPEAT; ++r) {
+                    for (Object *piece : pieces) {
+                        int piece_type = piece->get("piece_type");
+                        sink = sink + piece_type;
+                        ++ops;
+                    }
+                }
+                return ops;
+            });
+        }
+    }
+
+    Dictionary result;
+    result["samples"] = samples;
+    result["positions"] = static_cast<int>(positions.size());
+    result["primitives"] = primitives;
+    return result;
+}
+
+} // namespace Benchmark
@@ -0,0 +1,24 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include "board_state.hpp"
+#include <cstdint>
+#include <godot_cpp/variant/dictionary.hpp>
+
+// 指し手生成と探索の部品の速度計測
+namespace Benchmark {
+
+// 計測に使う局面（序盤・中盤・終盤）
+const int POSITION_COUNT = 5;
+extern const char *const POSITIONS[POSITION_COUNT];
+
+// board から depth 手先までの局面数（side が手番）
+uint64_t perft(const BoardState &board, int side, int depth);
+
+// 基本操作ごとに samples 回測り、1操作あたりの ns の分布を返す
+// main_node（main.gd と同じプロパティを持つノード）があれば、シーンから読む操作も測る
+Dictionary microbench(int samples, Node *main_node);
+
+} // namespace Benchmark
+
+#endif
@@ -1,55 +1,373 @@
 #include "board_state.hpp"
+#include "trace.hpp"
+#include "zobrist.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdlib>
 #include <godot_cpp/classes/node.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
+#include <sstream>
 
 using namespace godot;
 
 namespace {
 
+// 先手から見た方向（dy < 0 が前）。後手はコンパイル時に dy を反転する
 struct Direction {
     int dx;
     int dy;
+};
 
-    bool operator==(const Direction &other) const { return dx == other.dx && dy == other.dy; }
+// 成りを考慮した駒の動きの種類
+enum Kind {
+    KIND_KING,
+    KIND_GOLD, // 金と成金（と・成香・成桂・成銀）
+    KIND_SILVER,
+    KIND_KNIGHT,
+    KIND_LANCE,
+    KIND_PAWN,
+    KIND_ROOK,
+    KIND_BISHOP,
+    KIND_DRAGON, // 竜
+    KIND_HORSE,  // 馬
+    KIND_COUNT
 };
 
-const Direction DIR_UP = {0, -1};
-const Direction DIR_UP_RIGHT = {1, -1};
-const Direction DIR_RIGHT = {1, 0};
-const Direction DIR_DOWN_RIGHT = {1, 1};
-const Direction DIR_DOWN = {0, 1};
-const Direction DIR_DOWN_LEFT = {-1, 1};
-const Direction DIR_LEFT = {-1, 0};
-const Direction DIR_UP_LEFT = {-1, -1};
-const Direction DIR_KNIGHT_LEFT = {-1, -2};
-const Direction DIR_KNIGHT_RIGHT = {1, -2};
-
-const std::vector<Direction> MOVES_PAWN = {DIR_UP};
-const std::vector<Direction> MOVES_KNIGHT = {DIR_KNIGHT_LEFT, DIR_KNIGHT_RIGHT};
-const std::vector<Direction> MOVES_SILVER = {DIR_UP_LEFT, DIR_UP, DIR_UP_RIGHT, DIR_DOWN_LEFT, DIR_DOWN_RIGHT};
-const std::vector<Direction> MOVES_GOLD = {DIR_UP_LEFT, DIR_UP, DIR_UP_RIGHT, DIR_LEFT, DIR_RIGHT, DIR_DOWN};
-const std::vector<Direction> MOVES_KING = {DIR_UP_LEFT, DIR_UP,        DIR_UP_RIGHT, DIR_LEFT,
-                                           DIR_RIGHT,   DIR_DOWN_LEFT, DIR_DOWN,     DIR_DOWN_RIGHT};
-} // namespace
+constexpr std::array<Direction, 1> STEPS_PAWN = {{{0, -1}}};
+constexpr std::array<Direction, 2> STEPS_KNIGHT = {{{-1, -2}, {1, -2}}};
+constexpr std::array<Direction, 5> STEPS_SILVER = {{{-1, -1}, {0, -1}, {1, -1}, {-1, 1}, {1, 1}}};
+constexpr std::array<Direction, 6> STEPS_GOLD = {{{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {0, 1}}};
+constexpr std::array<Direction, 8> STEPS_KING = {
+    {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}}};
+constexpr std::array<Direction, 4> STEPS_DIAGONAL = {{{-1, -1}, {1, -1}, {-1, 1}, {1, 1}}};
+constexpr std::array<Direction, 4> STEPS_ORTHOGONAL = {{{0, -1}, {-1, 0}, {1, 0}, {0, 1}}};
+constexpr std::array<Direction, 0> STEPS_NONE = {};
+
+constexpr std::array<Direction, 1> RAYS_LANCE = {{{0, -1}}};
+constexpr std::array<Direction, 4> RAYS_ROOK = STEPS_ORTHOGONAL;
+constexpr std::array<Direction, 4> RAYS_BISHOP = STEPS_DIAGONAL;
+constexpr std::array<Direction, 0> RAYS_NONE = {};
+
+template <int K> constexpr const auto &steps() {
+    if constexpr (K == KIND_KING) {
+        return STEPS_KING;
+    } else if constexpr (K == KIND_GOLD) {
+        return STEPS_GOLD;
+    } else if constexpr (K == KIND_SILVER) {
+        return STEPS_SILVER;
+    } else if constexpr (K == KIND_KNIGHT) {
+        return STEPS_KNIGHT;
+    } else if constexpr (K == KIND_PAWN) {
+        return STEPS_PAWN;
+    } else if constexpr (K == KIND_DRAGON) {
+        return STEPS_DIAGONAL;
+    } else if constexpr (K == KIND_HORSE) {
+        return STEPS_ORTHOGONAL;
+    } else {
+        return STEPS_NONE;
+    }
+}
 
-BoardState::BoardState() {
-    // 盤面を初期化
-    for (int i = 0; i < Shogi::BOARD_SIZE; ++i) {
-        board[i] = Cell();
+template <int K> constexpr const auto &rays() {
+    if constexpr (K == KIND_LANCE) {
+        return RAYS_LANCE;
+    } else if constexpr (K == KIND_ROOK || K == KIND_DRAGON) {
+        return RAYS_ROOK;
+    } else if constexpr (K == KIND_BISHOP || K == KIND_HORSE) {
+        return RAYS_BISHOP;
+    } else {
+        return RAYS_NONE;
     }
+}
 
-    // 持ち駒を初期化
-    for (int side = 0; side < 2; ++side) {
-        for (int piece_type = 0; piece_type < Shogi::PIECE_TYPE_COUNT; ++piece_type) {
-            hand[side][piece_type] = 0;
+// 成れる駒の種類か
+template <int K> constexpr bool can_promote() {
+    return K == KIND_SILVER || K == KIND_KNIGHT || K == KIND_LANCE || K == KIND_PAWN || K == KIND_ROOK ||
+           K == KIND_BISHOP;
+}
+
+constexpr int kind_of(int piece_type, bool is_promoted) {
+    switch (piece_type) {
+    case Shogi::KING:
+        return KIND_KING;
+    case Shogi::ROOK:
+        return is_promoted ? KIND_DRAGON : KIND_ROOK;
+    case Shogi::BISHOP:
+        return is_promoted ? KIND_HORSE : KIND_BISHOP;
+    case Shogi::GOLD:
+        return KIND_GOLD;
+    case Shogi::SILVER:
+        return is_promoted ? KIND_GOLD : KIND_SILVER;
+    case Shogi::KNIGHT:
+        return is_promoted ? KIND_GOLD : KIND_KNIGHT;
+    case Shogi::LANCE:
+        return is_promoted ? KIND_GOLD : KIND_LANCE;
+    case Shogi::PAWN:
+        return is_promoted ? KIND_GOLD : KIND_PAWN;
+    default:
+        return KIND_COUNT;
+    }
+}
+
+// 盤面の符号の下位4ビット（成り + 駒種）から動きの種類を引く表
+constexpr std::array<uint8_t, 16> KIND_BY_SQUARE = {
+    KIND_KING, KIND_ROOK,   KIND_BISHOP, KIND_GOLD, KIND_SILVER, KIND_KNIGHT, KIND_LANCE, KIND_PAWN,
+    KIND_KING, KIND_DRAGON, KIND_HORSE,  KIND_GOLD, KIND_GOLD,   KIND_GOLD,   KIND_GOLD,  KIND_GOLD};
+
+// 盤面の1次元配列上での移動量
+constexpr int square_delta(int dx, int dy) { return dx * BoardState::MAILBOX_STRIDE + dy; }
+
+// 飛び駒の利きの向き（前半4つが縦横、後半4つが斜め）
+constexpr std::array<Direction, 8> LINE_DIRECTIONS = {
+    {{0, -1}, {-1, 0}, {1, 0}, {0, 1}, {-1, -1}, {1, -1}, {-1, 1}, {1, 1}}};
+
+constexpr int sign(int v) { return (v > 0) - (v < 0); }
+
+// (dx, dy) が (step_x, step_y) 向きの半直線上にあるか
+constexpr bool on_ray(int step_x, int step_y, int dx, int dy) {
+    return dx * step_y == dy * step_x && sign(dx) == step_x && sign(dy) == step_y;
+}
+
+// (col, row) が玉と王手している駒の間にあるか
+bool is_between_king_and_checker(const BoardState::KingDanger &danger, int col, int row) {
+    int step_x = sign(danger.checker_col - danger.king_col);
+    int step_y = sign(danger.checker_row - danger.king_row);
+    int distance =
+        std::max(std::abs(danger.checker_col - danger.king_col), std::abs(danger.checker_row - danger.king_row));
+    int dx = col - danger.king_col;
+    int dy = row - danger.king_row;
+    return on_ray(step_x, step_y, dx, dy) && std::max(std::abs(dx), std::abs(dy)) < distance;
+}
+
+// 持ち駒のビットフィールド（玉 飛 角 金 銀 桂 香 歩）。歩の上の 24〜30 ビットには玉のマスを置く
+constexpr std::array<int, Shogi::PIECE_TYPE_COUNT> HAND_SHIFT = {0, 2, 4, 6, 9, 12, 15, 18};
+constexpr std::array<uint32_t, Shogi::PIECE_TYPE_COUNT> HAND_MASK = {0x3, 0x3, 0x3, 0x7, 0x7, 0x7, 0x7, 0x1f};
+
+// 先手から見た手番側の前方向（後手は -1 倍）
+template <int S> constexpr int forward() { return S == Shogi::PLAYER ? 1 : -1; }
+
+template <int S> constexpr bool in_promotion_zone(int row) { return S == Shogi::PLAYER ? row <= 2 : row >= 6; }
+
+// 行き所のない段か（先手から見た段で判定）
+template <int S, int K> constexpr bool is_dead_end_row(int row) {
+    constexpr int limit = (K == KIND_KNIGHT) ? 2 : ((K == KIND_PAWN || K == KIND_LANCE) ? 1 : 0);
+    return S == Shogi::PLAYER ? row < limit : row >= Shogi::BOARD_ROWS - limit;
+}
+
+// 隣接8マスへの利き（先手から見た方向を (dy+1)*3+(dx+1) ビットで表す）
+constexpr uint16_t direction_bit(int dx, int dy) { return static_cast<uint16_t>(1u << ((dy + 1) * 3 + (dx + 1))); }
+
+template <size_t N> constexpr uint16_t adjacent_mask(const std::array<Direction, N> &dirs) {
+    uint16_t mask = 0;
+    for (size_t i = 0; i < N; ++i) {
+        if (dirs[i].dx >= -1 && dirs[i].dx <= 1 && dirs[i].dy >= -1 && dirs[i].dy <= 1) {
+            mask |= direction_bit(dirs[i].dx, dirs[i].dy);
+        }
+    }
+    return mask;
+}
+
+template <int K> constexpr uint16_t adjacent_attacks() { return adjacent_mask(steps<K>()) | adjacent_mask(rays<K>()); }
+
+constexpr std::array<uint16_t, KIND_COUNT + 1> ADJACENT_ATTACKS = {
+    adjacent_attacks<KIND_KING>(),   adjacent_attacks<KIND_GOLD>(),   adjacent_attacks<KIND_SILVER>(),
+    adjacent_attacks<KIND_KNIGHT>(), adjacent_attacks<KIND_LANCE>(),  adjacent_attacks<KIND_PAWN>(),
+    adjacent_attacks<KIND_ROOK>(),   adjacent_attacks<KIND_BISHOP>(), adjacent_attacks<KIND_DRAGON>(),
+    adjacent_attacks<KIND_HORSE>(),  0};
+
+// 駒の利きの形として (dx, dy) に動けるか（経路の遮りは見ない）
+template <int S, int K> bool geometry(int dx, int dy) {
+    // 先手から見た向きに直す
+    dy *= forward<S>();
+    dx *= forward<S>();
+
+    for (const Direction &d : steps<K>()) {
+        if (d.dx == dx && d.dy == dy) {
+            return true;
+        }
+    }
+
+    if constexpr (K == KIND_LANCE) {
+        return dx == 0 && dy < 0;
+    } else if constexpr (K == KIND_ROOK || K == KIND_DRAGON) {
+        return dx == 0 || dy == 0;
+    } else if constexpr (K == KIND_BISHOP || K == KIND_HORSE) {
+        return std::abs(dx) == std::abs(dy);
+    } else {
+        return false;
+    }
+}
+
+template <int S> bool geometry_for_kind(int kind, int dx, int dy) {
+    switch (kind) {
+    case KIND_KING:
+        return geometry<S, KIND_KING>(dx, dy);
+    case KIND_GOLD:
+        return geometry<S, KIND_GOLD>(dx, dy);
+    case KIND_SILVER:
+        return geometry<S, KIND_SILVER>(dx, dy);
+    case KIND_KNIGHT:
+        return geometry<S, KIND_KNIGHT>(dx, dy);
+    case KIND_LANCE:
+        return geometry<S, KIND_LANCE>(dx, dy);
+    case KIND_PAWN:
+        return geometry<S, KIND_PAWN>(dx, dy);
+    case KIND_ROOK:
+        return geometry<S, KIND_ROOK>(dx, dy);
+    case KIND_BISHOP:
+        return geometry<S, KIND_BISHOP>(dx, dy);
+    case KIND_DRAGON:
+        return geometry<S, KIND_DRAGON>(dx, dy);
+    case KIND_HORSE:
+        return geometry<S, KIND_HORSE>(dx, dy);
+    default:
+        return false;
+    }
+}
+
+// SFENの駒の文字（PieceType の順）
+const char SFEN_PIECES[] = "KRBGSNLP";
+
+// 持ち駒を書く順（飛 角 金 銀 桂 香 歩）
+const int SFEN_HAND_ORDER[] = {Shogi::ROOK,   Shogi::BISHOP, Shogi::GOLD, Shogi::SILVER,
+                               Shogi::KNIGHT, Shogi::LANCE,  Shogi::PAWN};
+
+int sfen_piece_type(char c) {
+    for (int type = 0; type < Shogi::PIECE_TYPE_COUNT; ++type) {
+        if (SFEN_PIECES[type] == c) {
+            return type;
+        }
+    }
+    return -1;
+}
+
+// 入玉宣言の点数（PieceType の順。飛角は成っていても5点、玉は数えない）
+constexpr std::array<int, Shogi::PIECE_TYPE_COUNT> DECLARE_POINTS = {0, 5, 5, 1, 1, 1, 1, 1};
+
+// 敵陣（相手側の3段）か。先手は 0 段目の方向へ進む
+bool is_enemy_camp(int side, int row) { return side == Shogi::PLAYER ? row <= 2 : row >= Shogi::BOARD_ROWS - 3; }
+
+int hand_declare_points(const BoardState &board, int side) {
+    int points = 0;
+    for (int type = Shogi::ROOK; type < Shogi::PIECE_TYPE_COUNT; ++type) {
+        points += DECLARE_POINTS[type] * board.get_hand_count(side, type);
+    }
+    return points;
+}
+
+// pack_sfen のハフマン符号（PieceType の順、先に書くビットが下位）
+// 盤上: 空き 0、歩 10、香 1100、桂 1101、銀 1110、金 11110、角 111110、飛 111111
+// に続けて成り（金を除く）と手番を1ビットずつ。持ち駒は先頭の1を省き、手番だけを続ける
+struct HuffmanCode {
+    uint8_t code;
+    int bits;
+};
+
+constexpr std::array<HuffmanCode, Shogi::PIECE_TYPE_COUNT> PIECE_CODES = {
+    {{0x00, 0}, {0x3f, 6}, {0x1f, 6}, {0x0f, 5}, {0x07, 4}, {0x0b, 4}, {0x03, 4}, {0x01, 2}}};
+
+// 平手の駒の枚数（両者の合計）。全部そろっていれば符号はちょうど256ビットに収まる
+constexpr std::array<int, Shogi::PIECE_TYPE_COUNT> PIECE_TOTALS = {2, 2, 2, 4, 4, 4, 4, 18};
+const int NON_KING_PIECES = 38;
+
+const int PACKED_BITS = BoardState::PACKED_SFEN_SIZE * 8;
+
+class BitWriter {
+  private:
+    uint8_t *data;
+    int cursor = 0;
+
+  public:
+    explicit BitWriter(uint8_t *p_data) : data(p_data) {}
+
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; ++i, ++cursor) {
+            if ((value >> i) & 1) {
+                data[cursor >> 3] |= static_cast<uint8_t>(1 << (cursor & 7));
+            }
+        }
+    }
+
+    void write_piece(int type, bool is_promoted, int side, bool on_board) {
+        const HuffmanCode &code = PIECE_CODES[type];
+        if (on_board) {
+            write(code.code, code.bits);
+            if (type != Shogi::GOLD) {
+                write(is_promoted ? 1 : 0, 1);
+            }
+        } else {
+            write(code.code >> 1, code.bits - 1);
         }
+        write(side, 1);
     }
+};
+
+class BitReader {
+  private:
+    const uint8_t *data;
+    int cursor = 0;
+
+  public:
+    explicit BitReader(const uint8_t *p_data) : data(p_data) {}
+
+    // 256ビットを超えて読もうとしたら 0 を返し、overflow で知らせる
+    uint32_t read(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; ++i, ++cursor) {
+            if (cursor < PACKED_BITS && ((data[cursor >> 3] >> (cursor & 7)) & 1)) {
+                value |= 1u << i;
+            }
+        }
+        return value;
+    }
+
+    bool overflow() const { return cursor > PACKED_BITS; }
+
+    // 駒の符号を読んで駒種を返す（盤上の空きは Shogi::EMPTY、壊れた符号は -1）
+    int read_type(bool on_board) {
+        uint32_t code = on_board ? 0 : 1;
+        int bits = on_board ? 0 : 1;
+        while (bits < 6) {
+            code |= read(1) << bits;
+            ++bits;
+            if (on_board && bits == 1 && code == 0) {
+                return Shogi::EMPTY;
+            }
+            for (int type = Shogi::ROOK; type < Shogi::PIECE_TYPE_COUNT; ++type) {
+                if (PIECE_CODES[type].bits == bits && PIECE_CODES[type].code == code) {
+                    return type;
+                }
+            }
+        }
+        return -1;
+    }
+};
+
+} // namespace
+
+BoardState::BoardState()
+    : hash_key(0) {
+    // 盤面を初期化（盤外はすべて番兵）
+    for (int i = 0; i < MAILBOX_SIZE; ++i) {
+        squares[i] = SQUARE_WALL;
+    }
+    for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+        for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
+            squares[mailbox_index(col, row)] = SQUARE_EMPTY;
+        }
+    }
+
+    // 持ち駒を初期化
+    hand[Shogi::PLAYER] = 0;
+    hand[Shogi::ENEMY] = 0;
 }
 
 void BoardState::init_from_main(Node *main_node) {
     if (main_node == nullptr) {
         return;
     }
+    SHOGI_TRACE_SCOPE("init_from_main", 0);
 
     // 盤上の駒を読み込み
     Array board_grid = main_node->get("board_grid");
@@ -69,16 +387,14 @@ void BoardState::init_from_main(Node *main_node) {
             Variant cell_data = row_array[row];
             Object *piece = Object::cast_to<Object>(cell_data);
 
-            int index = col * Shogi::BOARD_ROWS + row;
-
             if (piece != nullptr) {
                 int piece_type = piece->get("piece_type");
                 bool is_enemy = piece->get("is_enemy");
                 bool is_promoted = piece->get("is_promoted");
 
-                board[index] = Cell(piece_type, is_enemy ? Shogi::ENEMY : Shogi::PLAYER, is_promoted);
+                set_cell(col, row, piece_type, is_enemy ? Shogi::ENEMY : Shogi::PLAYER, is_promoted);
             } else {
-                board[index] = Cell();
+                clear_cell(col, row);
             }
         }
     }
@@ -101,7 +417,7 @@ void BoardState::init_from_main(Node *main_node) {
                 if (v_type.get_type() == Variant::INT) {
                     int piece_type = v_type;
                     if (piece_type >= 0 && piece_type < Shogi::PIECE_TYPE_COUNT) {
-                        hand[side][piece_type]++;
+                        add_hand(side, piece_type, 1);
                     }
                 }
             }
@@ -109,6 +425,281 @@ void BoardState::init_from_main(Node *main_node) {
     }
 }
 
+void BoardState::init_startpos() {
+    *this = BoardState();
+
+    // board.gd の setup_starting_board と同じ配置
+    for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+        set_cell(col, 6, Shogi::PAWN, Shogi::PLAYER, false);
+        set_cell(Shogi::BOARD_COLS - 1 - col, 2, Shogi::PAWN, Shogi::ENEMY, false);
+    }
+
+    set_cell(1, 7, Shogi::BISHOP, Shogi::PLAYER, false);
+    set_cell(7, 7, Shogi::ROOK, Shogi::PLAYER, false);
+    set_cell(7, 1, Shogi::BISHOP, Shogi::ENEMY, false);
+    set_cell(1, 1, Shogi::ROOK, Shogi::ENEMY, false);
+
+    const int bottom_row_types[Shogi::BOARD_COLS] = {Shogi::LANCE,  Shogi::KNIGHT, Shogi::SILVER,
+                                                     Shogi::GOLD,   Shogi::KING,   Shogi::GOLD,
+                                                     Shogi::SILVER, Shogi::KNIGHT, Shogi::LANCE};
+    for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+        set_cell(col, 8, bottom_row_types[col], Shogi::PLAYER, false);
+        set_cell(Shogi::BOARD_COLS - 1 - col, 0, bottom_row_types[col], Shogi::ENEMY, false);
+    }
+}
+
+bool BoardState::set_sfen(const std::string &sfen, int &side_to_move) {
+    if (sfen == "startpos") {
+        init_startpos();
+        side_to_move = Shogi::PLAYER;
+        return true;
+    }
+
+    std::istringstream stream(sfen);
+    std::string board_part;
+    std::string side_part;
+    std::string hand_part;
+    if (!(stream >> board_part >> side_part >> hand_part)) {
+        return false;
+    }
+
+    BoardState parsed;
+
+    // 盤面は一段目から、各段は9筋（画面の左端）から
+    int col = 0;
+    int row = 0;
+    bool promoted = false;
+    for (char c : board_part) {
+        if (c == '/') {
+            if (col != Shogi::BOARD_COLS) {
+                return false;
+            }
+            ++row;
+            col = 0;
+        } else if (c >= '1' && c <= '9') {
+            col += c - '0';
+        } else if (c == '+') {
+            promoted = true;
+        } else {
+            int side = (c >= 'a' && c <= 'z') ? Shogi::ENEMY : Shogi::PLAYER;
+            int type = sfen_piece_type(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+            if (type < 0 || !is_valid_coord(col, row)) {
+                return false;
+            }
+            parsed.set_cell(col, row, type, side, promoted);
+            promoted = false;
+            ++col;
+        }
+    }
+    if (row != Shogi::BOARD_ROWS - 1 || col != Shogi::BOARD_COLS) {
+        return false;
+    }
+
+    if (side_part == "b") {
+        side_to_move = Shogi::PLAYER;
+    } else if (side_part == "w") {
+        side_to_move = Shogi::ENEMY;
+    } else {
+        return false;
+    }
+
+    if (hand_part != "-") {
+        int count = 0;
+        for (char c : hand_part) {
+            if (c >= '0' && c <= '9') {
+                count = count * 10 + (c - '0');
+                continue;
+            }
+            int side = (c >= 'a' && c <= 'z') ? Shogi::ENEMY : Shogi::PLAYER;
+            int type = sfen_piece_type(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+            if (type <= Shogi::KING) {
+                return false;
+            }
+            parsed.add_hand(side, type, std::max(1, count));
+            count = 0;
+        }
+    }
+
+    *this = parsed;
+    return true;
+}
+
+std::string BoardState::get_sfen(int side_to_move, int ply) const {
+    std::string sfen;
+
+    for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
+        int empty = 0;
+        for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+            Cell cell = get_cell(col, row);
+            if (cell.is_empty()) {
+                ++empty;
+                continue;
+            }
+            if (empty > 0) {
+                sfen += static_cast<char>('0' + empty);
+                empty = 0;
+            }
+            if (cell.is_promoted) {
+                sfen += '+';
+            }
+            char c = SFEN_PIECES[cell.type];
+            sfen += (cell.side == Shogi::ENEMY) ? static_cast<char>(std::tolower(c)) : c;
+        }
+        if (empty > 0) {
+            sfen += static_cast<char>('0' + empty);
+        }
+        if (row < Shogi::BOARD_ROWS - 1) {
+            sfen += '/';
+        }
+    }
+
+    sfen += (side_to_move == Shogi::ENEMY) ? " w" : " b";
+
+    std::string hand_part;
+    for (int side = 0; side < 2; ++side) {
+        for (int type : SFEN_HAND_ORDER) {
+            int count = get_hand_count(side, type);
+            if (count == 0) {
+                continue;
+            }
+            if (count > 1) {
+                hand_part += std::to_string(count);
+            }
+            char c = SFEN_PIECES[type];
+            hand_part += (side == Shogi::ENEMY) ? static_cast<char>(std::tolower(c)) : c;
+        }
+    }
+    sfen += " " + (hand_part.empty() ? std::string("-") : hand_part);
+    sfen += " " + std::to_string(ply);
+
+    return sfen;
+}
+
+bool BoardState::pack_sfen(int side_to_move, uint8_t *out) const {
+    // 駒が欠けた局面（詰将棋など）は表せない
+    int counts[Shogi::PIECE_TYPE_COUNT] = {};
+    for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+        for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
+            uint8_t square = squares[mailbox_index(col, row)];
+            if (square != SQUARE_EMPTY) {
+                ++counts[square & SQUARE_TYPE_MASK];
+            }
+        }
+    }
+    for (int type = Shogi::ROOK; type < Shogi::PIECE_TYPE_COUNT; ++type) {
+        counts[type] += get_hand_count(Shogi::PLAYER, type) + get_hand_count(Shogi::ENEMY, type);
+    }
+    for (int type = 0; type < Shogi::PIECE_TYPE_COUNT; ++type) {
+        if (counts[type] != PIECE_TOTALS[type]) {
+            return false;
+        }
+    }
+    if (king_square(Shogi::PLAYER) == NO_SQUARE || king_square(Shogi::ENEMY) == NO_SQUARE) {
+        return false;
+    }
+
+    std::fill(out, out + PACKED_SFEN_SIZE, 0);
+    BitWriter writer(out);
+
+    // 手番、両者の玉の位置（7ビット）、玉以外の盤上81マス、持ち駒の順
+    writer.write(side_to_move == Shogi::ENEMY ? 1 : 0, 1);
+    for (int side = 0; side < 2; ++side) {
+        int col = king_square(side) / MAILBOX_STRIDE - 1;
+        int row = king_square(side) % MAILBOX_STRIDE - 1;
+        writer.write(col * Shogi::BOARD_ROWS + row, 7);
+    }
+
+    for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+        for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
+            uint8_t square = squares[mailbox_index(col, row)];
+            if (square == SQUARE_EMPTY) {
+                writer.write(0, 1);
+                continue;
+            }
+            int type = square & SQUARE_TYPE_MASK;
+            if (type != Shogi::KING) {
+                writer.write_piece(type, (square & SQUARE_PROMOTED) != 0, (square >> SQUARE_SIDE_SHIFT) & 1, true);
+            }
+        }
+    }
+
+    for (int side = 0; side < 2; ++side) {
+        for (int type = Shogi::ROOK; type < Shogi::PIECE_TYPE_COUNT; ++type) {
+            for (int i = get_hand_count(side, type); i > 0; --i) {
+                writer.write_piece(type, false, side, false);
+            }
+        }
+    }
+    return true;
+}
+
+bool BoardState::unpack_sfen(const uint8_t *data, int &side_to_move) {
+    BoardState parsed;
+    BitReader reader(data);
+
+    int side_bit = static_cast<int>(reader.read(1));
+    int kings[2];
+    for (int side = 0; side < 2; ++side) {
+        kings[side] = static_cast<int>(reader.read(7));
+        if (kings[side] >= Shogi::BOARD_SIZE) {
+            return false;
+        }
+    }
+    if (kings[0] == kings[1]) {
+        return false;
+    }
+    for (int side = 0; side < 2; ++side) {
+        parsed.set_cell(kings[side] / Shogi::BOARD_ROWS, kings[side] % Shogi::BOARD_ROWS, Shogi::KING, side, false);
+    }
+
+    int counts[Shogi::PIECE_TYPE_COUNT] = {2};
+    int placed = 0;
+    for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+        for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
+            int index = col * Shogi::BOARD_ROWS + row;
+            if (index == kings[0] || index == kings[1]) {
+                continue;
+            }
+            int type = reader.read_type(true);
+            if (type < 0) {
+                return false;
+            }
+            if (type == Shogi::EMPTY) {
+                continue;
+            }
+            bool is_promoted = type != Shogi::GOLD && reader.read(1) != 0;
+            int side = static_cast<int>(reader.read(1));
+            parsed.set_cell(col, row, type, side, is_promoted);
+            ++counts[type];
+            ++placed;
+        }
+    }
+
+    // 盤上にない駒はすべて持ち駒
+    for (int i = placed; i < NON_KING_PIECES; ++i) {
+        int type = reader.read_type(false);
+        if (type < 0) {
+            return false;
+        }
+        int side = static_cast<int>(reader.read(1));
+        parsed.add_hand(side, type, 1);
+        ++counts[type];
+    }
+
+    if (reader.overflow()) {
+        return false;
+    }
+    for (int type = 0; type < Shogi::PIECE_TYPE_COUNT; ++type) {
+        if (counts[type] != PIECE_TOTALS[type]) {
+            return false;
+        }
+    }
+
+    side_to_move = side_bit ? Shogi::ENEMY : Shogi::PLAYER;
+    *this = parsed;
+    return true;
+}
+
 bool BoardState::is_valid_move(int from_col, int from_row, int to_col, int to_row) const {
     // 盤面の範囲外には移動不可
     if (!is_valid_coord(to_col, to_row)) {
@@ -120,7 +711,7 @@ bool BoardState::is_valid_move(int from_col, int from_row, int to_col, int to_ro
         return false;
     }
 
-    const Cell &piece = get_cell(from_col, from_row);
+    Cell piece = get_cell(from_col, from_row);
     bool is_enemy = (piece.side == Shogi::ENEMY);
 
     // ルールで認められていない場所には移動不可
@@ -135,7 +726,7 @@ bool BoardState::is_valid_move(int from_col, int from_row, int to_col, int to_ro
     }
 
     // 味方の駒がある場所には移動不可
-    const Cell &target = get_cell(to_col, to_row);
+    Cell target = get_cell(to_col, to_row);
     if (!target.is_empty() && target.side == piece.side) {
         return false;
     }
@@ -198,13 +789,22 @@ bool BoardState::is_legal_drop(int piece_type, bool is_enemy, int to_col, int to
     BoardState next_state = *this;
     int side = is_enemy ? Shogi::ENEMY : Shogi::PLAYER;
     next_state.set_cell(to_col, to_row, piece_type, side, false);
-    next_state.hand[side][piece_type]--;
+    next_state.add_hand(side, piece_type, -1);
 
     // 王手放置になる手を除外
     if (next_state.is_king_in_check(side)) {
         return false;
     }
 
+    // 打ち歩詰めは反則
+    if (piece_type == Shogi::PAWN) {
+        bool is_mate = is_enemy ? is_pawn_drop_mate<Shogi::ENEMY>(to_col, to_row)
+                                : is_pawn_drop_mate<Shogi::PLAYER>(to_col, to_row);
+        if (is_mate) {
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -212,82 +812,9 @@ bool BoardState::can_move_geometry(int piece_type, bool is_enemy, bool is_promot
                                    int to_col, int to_row) const {
     int dx = to_col - from_col;
     int dy = to_row - from_row;
+    int kind = kind_of(piece_type, is_promoted);
 
-    if (is_enemy) {
-        dx = -dx;
-        dy = -dy;
-    }
-
-    int effective_type = piece_type;
-
-    if (is_promoted) {
-        switch (piece_type) {
-        case Shogi::SILVER:
-        case Shogi::KNIGHT:
-        case Shogi::LANCE:
-        case Shogi::PAWN:
-            effective_type = Shogi::GOLD;
-            break;
-        default:
-            break;
-        }
-    }
-
-    int abs_dx = std::abs(dx);
-    int abs_dy = std::abs(dy);
-
-    switch (effective_type) {
-    case Shogi::ROOK:
-        if (dx == 0 || dy == 0) {
-            return true;
-        }
-        if (is_promoted && abs_dx <= 1 && abs_dy <= 1) {
-            return true;
-        }
-
-        return false;
-    case Shogi::BISHOP:
-        if (abs_dx == abs_dy) {
-            return true;
-        }
-        if (is_promoted && abs_dx + abs_dy <= 1) {
-            return true;
-        }
-        return false;
-    case Shogi::LANCE:
-        return (dx == 0 && dy < 0);
-    default:
-        Direction move_dir = {dx, dy};
-        const std::vector<Direction> *moves = nullptr;
-
-        switch (effective_type) {
-        case Shogi::KING:
-            moves = &MOVES_KING;
-            break;
-        case Shogi::GOLD:
-            moves = &MOVES_GOLD;
-            break;
-        case Shogi::SILVER:
-            moves = &MOVES_SILVER;
-            break;
-        case Shogi::KNIGHT:
-            moves = &MOVES_KNIGHT;
-            break;
-        case Shogi::PAWN:
-            moves = &MOVES_PAWN;
-            break;
-        }
-
-        if (moves) {
-            for (const auto &def : *moves) {
-                if (def == move_dir) {
-                    return true;
-                }
-            }
-        }
-
-        return false;
-    }
+    return is_enemy ? geometry_for_kind<Shogi::ENEMY>(kind, dx, dy) : geometry_for_kind<Shogi::PLAYER>(kind, dx, dy);
 }
 
 bool BoardState::is_path_blocked(int from_col, int from_row, int to_col, int to_row) const {
@@ -331,9 +858,9 @@ bool BoardState::is_nifu(int piece_type, int side, int col) const {
         return false;
     }
 
+    const uint8_t pawn = encode_square(Shogi::PAWN, side, false);
     for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
-        const Cell &cell = get_cell(col, row);
-        if (!cell.is_empty() && cell.side == side && cell.type == Shogi::PAWN && !cell.is_promoted) {
+        if (squares[mailbox_index(col, row)] == pawn) {
             return true;
         }
     }
@@ -343,94 +870,678 @@ bool BoardState::is_nifu(int piece_type, int side, int col) const {
 
 bool BoardState::is_king_in_check(int side) const {
     std::pair<int, int> king_pos = find_king_position(side);
-    int king_col = king_pos.first;
-    int king_row = king_pos.second;
-
-    if (king_col == -1 || king_row == -1) {
+    if (king_pos.first == -1) {
         return false;
     }
 
-    int enemy_side = (side == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+    if (side == Shogi::PLAYER) {
+        return is_attacked_by<Shogi::ENEMY>(king_pos.first, king_pos.second);
+    }
+    return is_attacked_by<Shogi::PLAYER>(king_pos.first, king_pos.second);
+}
+
+bool BoardState::is_king_in_enemy_camp(int side) const {
+    std::pair<int, int> king_pos = find_king_position(side);
+    return king_pos.first != -1 && is_enemy_camp(side, king_pos.second);
+}
+
+int BoardState::get_king_advance(int side) const {
+    std::pair<int, int> king_pos = find_king_position(side);
+    if (king_pos.first == -1) {
+        return 0;
+    }
+    int middle = Shogi::BOARD_ROWS / 2;
+    int advance = (side == Shogi::PLAYER) ? middle - king_pos.second : king_pos.second - middle;
+    return std::max(advance, 0);
+}
 
+void BoardState::count_camp(int side, int &pieces, int &points) const {
+    pieces = 0;
+    points = 0;
+    int first_row = (side == Shogi::PLAYER) ? 0 : Shogi::BOARD_ROWS - 3;
     for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
-        for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
-            const Cell &cell = get_cell(col, row);
-            if (cell.is_empty() || cell.side != enemy_side) {
+        for (int row = first_row; row < first_row + 3; ++row) {
+            uint8_t square = squares[mailbox_index(col, row)];
+            if (is_side_square(square, side) && (square & SQUARE_TYPE_MASK) != Shogi::KING) {
+                ++pieces;
+                points += DECLARE_POINTS[square & SQUARE_TYPE_MASK];
+            }
+        }
+    }
+}
+
+int BoardState::get_camp_piece_count(int side) const {
+    int pieces, points;
+    count_camp(side, pieces, points);
+    return pieces;
+}
+
+int BoardState::get_impasse_points(int side) const {
+    int pieces, points;
+    count_camp(side, pieces, points);
+    return points + hand_declare_points(*this, side);
+}
+
+bool BoardState::can_declare_win(int side) const {
+    // 探索の各局面で呼ぶので、玉の位置だけで済む条件を先に調べ、王手の判定は最後にする
+    if (!is_king_in_enemy_camp(side)) {
+        return false;
+    }
+    int pieces, points;
+    count_camp(side, pieces, points);
+    if (pieces < DECLARE_CAMP_PIECES) {
+        return false;
+    }
+    points += hand_declare_points(*this, side);
+    if (points < (side == Shogi::PLAYER ? DECLARE_POINTS_SENTE : DECLARE_POINTS_GOTE)) {
+        return false;
+    }
+    return !is_king_in_check(side);
+}
+
+template <int A> bool BoardState::is_attacked_by(int col, int row) const {
+    constexpr int f = forward<A>();
+    const int target = mailbox_index(col, row);
+
+    // 隣接するマスからの利き（盤外は番兵なので範囲判定はいらない）
+    for (int ay = -1; ay <= 1; ++ay) {
+        for (int ax = -1; ax <= 1; ++ax) {
+            if (ax == 0 && ay == 0) {
                 continue;
             }
+            uint8_t square = squares[target + square_delta(ax, ay)];
+            if (!is_side_square(square, A)) {
+                continue;
+            }
+            // 攻め方から見た向きに直す
+            if (ADJACENT_ATTACKS[KIND_BY_SQUARE[square & 0x0f]] & direction_bit(-ax * f, -ay * f)) {
+                return true;
+            }
+        }
+    }
+
+    // 桂馬の利き（2段先は番兵を越えるので座標で判定する）
+    const uint8_t knight = encode_square(Shogi::KNIGHT, A, false);
+    for (const Direction &d : STEPS_KNIGHT) {
+        int c = col - d.dx * f;
+        int r = row - d.dy * f;
+        if (is_valid_coord(c, r) && squares[mailbox_index(c, r)] == knight) {
+            return true;
+        }
+    }
+
+    // 飛び駒の利き（2マス以上離れたもの）
+    const uint8_t rook = encode_square(Shogi::ROOK, A, false);
+    const uint8_t bishop = encode_square(Shogi::BISHOP, A, false);
+    const uint8_t lance = encode_square(Shogi::LANCE, A, false);
+    for (int i = 0; i < 8; ++i) {
+        const Direction &d = LINE_DIRECTIONS[i];
+        const int delta = square_delta(d.dx, d.dy);
+        int index = target + delta;
+        if (squares[index] != SQUARE_EMPTY) {
+            continue;
+        }
+
+        index += delta;
+        while (squares[index] == SQUARE_EMPTY) {
+            index += delta;
+        }
 
-            if (is_valid_move(col, row, king_col, king_row)) {
+        // 竜・馬も成りビットを落とせば飛車・角と同じ
+        uint8_t square = squares[index] & ~SQUARE_PROMOTED;
+        if (i < 4) {
+            if (square == rook) {
                 return true;
             }
+            // 香車は攻め方の前方から来る利きだけ
+            if (squares[index] == lance && d.dx == 0 && d.dy == f) {
+                return true;
+            }
+        } else if (square == bishop) {
+            return true;
         }
     }
 
     return false;
 }
 
-std::pair<int, int> BoardState::find_king_position(int side) const {
+template <int S> void BoardState::compute_king_danger(KingDanger &danger) const {
+    constexpr int A = (S == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+    constexpr int f = forward<A>();
+
+    danger = KingDanger();
+    const int king = king_square(S);
+    if (king == NO_SQUARE) {
+        return;
+    }
+    danger.king_col = king / MAILBOX_STRIDE - 1;
+    danger.king_row = king % MAILBOX_STRIDE - 1;
+
+    auto add_checker = [&](int index, bool is_distant) {
+        ++danger.checker_count;
+        danger.checker_col = index / MAILBOX_STRIDE - 1;
+        danger.checker_row = index % MAILBOX_STRIDE - 1;
+        danger.checker_is_distant = is_distant;
+    };
+
+    // 玉から8方向に見て、最初の相手の駒が利いていれば王手、
+    // 最初の自分の駒の先に相手の飛び駒があればその駒はピンされている
+    const uint8_t rook = encode_square(Shogi::ROOK, A, false);
+    const uint8_t bishop = encode_square(Shogi::BISHOP, A, false);
+    const uint8_t lance = encode_square(Shogi::LANCE, A, false);
+    for (int i = 0; i < 8; ++i) {
+        const Direction &d = LINE_DIRECTIONS[i];
+        const int delta = square_delta(d.dx, d.dy);
+
+        // この向きに玉まで利きが通る飛び駒か（竜・馬は成りビットを落とす）
+        auto is_line_attacker = [&](uint8_t square) {
+            if (i < 4) {
+                return (square & ~SQUARE_PROMOTED) == rook || (square == lance && d.dx == 0 && d.dy == f);
+            }
+            return (square & ~SQUARE_PROMOTED) == bishop;
+        };
+
+        int index = king + delta;
+        while (squares[index] == SQUARE_EMPTY) {
+            index += delta;
+        }
+
+        uint8_t square = squares[index];
+        if (is_side_square(square, A)) {
+            if (index == king + delta) {
+                if (ADJACENT_ATTACKS[KIND_BY_SQUARE[square & 0x0f]] & direction_bit(-d.dx * f, -d.dy * f)) {
+                    add_checker(index, false);
+                }
+            } else if (is_line_attacker(square)) {
+                add_checker(index, true);
+            }
+            continue;
+        }
+        if (!is_side_square(square, S)) {
+            continue; // 盤外
+        }
+
+        int pinned = index;
+        index += delta;
+        while (squares[index] == SQUARE_EMPTY) {
+            index += delta;
+        }
+        if (is_side_square(squares[index], A) && is_line_attacker(squares[index])) {
+            danger.pinned_col[danger.pin_count] = pinned / MAILBOX_STRIDE - 1;
+            danger.pinned_row[danger.pin_count] = pinned % MAILBOX_STRIDE - 1;
+            danger.pin_dx[danger.pin_count] = d.dx;
+            danger.pin_dy[danger.pin_count] = d.dy;
+            ++danger.pin_count;
+        }
+    }
+
+    // 桂馬の王手
+    const uint8_t knight = encode_square(Shogi::KNIGHT, A, false);
+    for (const Direction &d : STEPS_KNIGHT) {
+        int c = danger.king_col - d.dx * f;
+        int r = danger.king_row - d.dy * f;
+        if (is_valid_coord(c, r) && squares[mailbox_index(c, r)] == knight) {
+            add_checker(mailbox_index(c, r), false);
+        }
+    }
+}
+
+template <int S> bool BoardState::is_legal_pseudo_move(const Shogi::Move &move, const KingDanger &danger) const {
+    constexpr int opponent = (S == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+
+    if (!move.is_drop && move.from_col == danger.king_col && move.from_row == danger.king_row) {
+        // 玉の移動だけは、玉の陰になっていた飛び駒の利きもあるので動かしてから調べる
+        BoardState next_state = *this;
+        next_state.apply_move(move, S);
+        return !next_state.is_attacked_by<opponent>(move.to_col, move.to_row);
+    }
+
+    // 両王手は玉を動かすしかない
+    if (danger.checker_count >= 2) {
+        return false;
+    }
+
+    // 王手されていれば、王手している駒を取るか間に合い駒をする
+    if (danger.checker_count == 1) {
+        bool captures = !move.is_drop && move.to_col == danger.checker_col && move.to_row == danger.checker_row;
+        bool blocks = danger.checker_is_distant && is_between_king_and_checker(danger, move.to_col, move.to_row);
+        if (!captures && !blocks) {
+            return false;
+        }
+    }
+
+    if (move.is_drop) {
+        return true;
+    }
+
+    // ピンされた駒は玉と相手の飛び駒を結ぶ線上しか動けない
+    for (int i = 0; i < danger.pin_count; ++i) {
+        if (danger.pinned_col[i] == move.from_col && danger.pinned_row[i] == move.from_row) {
+            return on_ray(danger.pin_dx[i], danger.pin_dy[i], move.to_col - danger.king_col,
+                          move.to_row - danger.king_row);
+        }
+    }
+
+    return true;
+}
+
+template <int A> bool BoardState::can_capture_without_king(int col, int row, const KingDanger &danger) const {
+    constexpr int f = forward<A>();
+    const int target = mailbox_index(col, row);
+
+    // ピンされた駒は線上から外れる取り方はできない
+    auto can_leave = [&](int from) {
+        int from_col = from / MAILBOX_STRIDE - 1;
+        int from_row = from % MAILBOX_STRIDE - 1;
+        for (int i = 0; i < danger.pin_count; ++i) {
+            if (danger.pinned_col[i] == from_col && danger.pinned_row[i] == from_row) {
+                return on_ray(danger.pin_dx[i], danger.pin_dy[i], col - danger.king_col, row - danger.king_row);
+            }
+        }
+        return true;
+    };
+
+    // 隣接するマスから
+    for (int ay = -1; ay <= 1; ++ay) {
+        for (int ax = -1; ax <= 1; ++ax) {
+            int from = target + square_delta(ax, ay);
+            uint8_t square = squares[from];
+            if ((ax == 0 && ay == 0) || !is_side_square(square, A) || (square & 0x0f) == Shogi::KING) {
+                continue;
+            }
+            if ((ADJACENT_ATTACKS[KIND_BY_SQUARE[square & 0x0f]] & direction_bit(-ax * f, -ay * f)) &&
+                can_leave(from)) {
+                return true;
+            }
+        }
+    }
+
+    // 桂馬
+    const uint8_t knight = encode_square(Shogi::KNIGHT, A, false);
+    for (const Direction &d : STEPS_KNIGHT) {
+        int c = col - d.dx * f;
+        int r = row - d.dy * f;
+        if (is_valid_coord(c, r) && squares[mailbox_index(c, r)] == knight && can_leave(mailbox_index(c, r))) {
+            return true;
+        }
+    }
+
+    // 2マス以上離れた飛び駒
+    const uint8_t rook = encode_square(Shogi::ROOK, A, false);
+    const uint8_t bishop = encode_square(Shogi::BISHOP, A, false);
+    const uint8_t lance = encode_square(Shogi::LANCE, A, false);
+    for (int i = 0; i < 8; ++i) {
+        const Direction &d = LINE_DIRECTIONS[i];
+        const int delta = square_delta(d.dx, d.dy);
+        int index = target + delta;
+        if (squares[index] != SQUARE_EMPTY) {
+            continue;
+        }
+        while (squares[index] == SQUARE_EMPTY) {
+            index += delta;
+        }
+
+        uint8_t square = squares[index] & ~SQUARE_PROMOTED;
+        bool attacks = (i < 4) ? (square == rook || (squares[index] == lance && d.dx == 0 && d.dy == f))
+                               : square == bishop;
+        if (attacks && can_leave(index)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template <int S> bool BoardState::is_pawn_drop_mate(int col, int row) const {
+    constexpr int opponent = (S == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+
+    // 歩が相手玉の頭に打たれるときだけ王手になる
+    if (king_square(opponent) != mailbox_index(col, row) + square_delta(0, -forward<S>())) {
+        return false;
+    }
+
+    BoardState next_state = *this;
+    next_state.put_square(col, row, encode_square(Shogi::PAWN, S, false));
+
+    KingDanger danger;
+    next_state.compute_king_danger<opponent>(danger);
+
+    // 打った歩を玉以外の駒で取れるなら詰みではない（隣接の王手なので合い駒はきかない）
+    if (next_state.can_capture_without_king<opponent>(col, row, danger)) {
+        return false;
+    }
+
+    // 玉の逃げ道（打った歩を取る手も含む）
+    const int king = king_square(opponent);
+    for (const Direction &d : STEPS_KING) {
+        int to_col = danger.king_col + d.dx;
+        int to_row = danger.king_row + d.dy;
+        uint8_t target = next_state.squares[king + square_delta(d.dx, d.dy)];
+        if (target == SQUARE_WALL || is_side_square(target, opponent)) {
+            continue;
+        }
+        Shogi::Move escape(danger.king_col, danger.king_row, to_col, to_row, Shogi::KING, false, false,
+                           target != SQUARE_EMPTY);
+        if (next_state.is_legal_pseudo_move<opponent>(escape, danger)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <int S, int K>
+void BoardState::add_piece_moves(int from_col, int from_row, int to_col, int to_row, int piece_type, bool is_capture,
+                                 std::vector<Shogi::Move> &moves) const {
+    if constexpr (can_promote<K>()) {
+        bool in_zone = in_promotion_zone<S>(from_row) || in_promotion_zone<S>(to_row);
+        if (!is_dead_end_row<S, K>(to_row)) {
+            moves.emplace_back(from_col, from_row, to_col, to_row, piece_type, false, false, is_capture);
+        }
+        if (in_zone) {
+            moves.emplace_back(from_col, from_row, to_col, to_row, piece_type, true, false, is_capture);
+        }
+    } else {
+        moves.emplace_back(from_col, from_row, to_col, to_row, piece_type, false, false, is_capture);
+    }
+}
+
+template <int S, int K>
+void BoardState::generate_piece_moves(int col, int row, int piece_type, std::vector<Shogi::Move> &moves) const {
+    constexpr int f = forward<S>();
+    const int from = mailbox_index(col, row);
+
+    for (const Direction &d : steps<K>()) {
+        int to_col = col + d.dx * f;
+        int to_row = row + d.dy * f;
+        if constexpr (K == KIND_KNIGHT) {
+            // 桂馬だけは番兵1マスを飛び越える
+            if (!is_valid_coord(to_col, to_row)) {
+                continue;
+            }
+        }
+        uint8_t target = squares[from + square_delta(d.dx * f, d.dy * f)];
+        if (target == SQUARE_EMPTY) {
+            add_piece_moves<S, K>(col, row, to_col, to_row, piece_type, false, moves);
+        } else if (is_side_square(target, 1 - S)) {
+            add_piece_moves<S, K>(col, row, to_col, to_row, piece_type, true, moves);
+        }
+    }
+
+    for (const Direction &d : rays<K>()) {
+        const int delta = square_delta(d.dx * f, d.dy * f);
+        int to_col = col + d.dx * f;
+        int to_row = row + d.dy * f;
+        for (int to = from + delta;; to += delta) {
+            uint8_t target = squares[to];
+            if (target != SQUARE_EMPTY) {
+                if (is_side_square(target, 1 - S)) {
+                    add_piece_moves<S, K>(col, row, to_col, to_row, piece_type, true, moves);
+                }
+                break;
+            }
+            add_piece_moves<S, K>(col, row, to_col, to_row, piece_type, false, moves);
+            to_col += d.dx * f;
+            to_row += d.dy * f;
+        }
+    }
+}
+
+template <int S> void BoardState::generate_moves(std::vector<Shogi::Move> &moves) const {
+    // 自分の歩がある筋（二歩の判定用）
+    int pawn_files = 0;
+
     for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
         for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
-            const Cell &cell = get_cell(col, row);
-            if (cell.side == side && cell.type == Shogi::KING) {
-                return {col, row};
+            uint8_t square = squares[mailbox_index(col, row)];
+            if (!is_side_square(square, S)) {
+                continue;
+            }
+
+            int piece_type = square & SQUARE_TYPE_MASK;
+            switch (KIND_BY_SQUARE[square & 0x0f]) {
+            case KIND_KING:
+                generate_piece_moves<S, KIND_KING>(col, row, piece_type, moves);
+                break;
+            case KIND_GOLD:
+                generate_piece_moves<S, KIND_GOLD>(col, row, piece_type, moves);
+                break;
+            case KIND_SILVER:
+                generate_piece_moves<S, KIND_SILVER>(col, row, piece_type, moves);
+                break;
+            case KIND_KNIGHT:
+                generate_piece_moves<S, KIND_KNIGHT>(col, row, piece_type, moves);
+                break;
+            case KIND_LANCE:
+                generate_piece_moves<S, KIND_LANCE>(col, row, piece_type, moves);
+                break;
+            case KIND_PAWN:
+                pawn_files |= 1 << col;
+                generate_piece_moves<S, KIND_PAWN>(col, row, piece_type, moves);
+                break;
+            case KIND_ROOK:
+                generate_piece_moves<S, KIND_ROOK>(col, row, piece_type, moves);
+                break;
+            case KIND_BISHOP:
+                generate_piece_moves<S, KIND_BISHOP>(col, row, piece_type, moves);
+                break;
+            case KIND_DRAGON:
+                generate_piece_moves<S, KIND_DRAGON>(col, row, piece_type, moves);
+                break;
+            case KIND_HORSE:
+                generate_piece_moves<S, KIND_HORSE>(col, row, piece_type, moves);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // 駒打ち
+    for (int piece_type = 0; piece_type < Shogi::PIECE_TYPE_COUNT; ++piece_type) {
+        if (get_hand_count(S, piece_type) <= 0) {
+            continue;
+        }
+
+        for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+            if (piece_type == Shogi::PAWN && (pawn_files & (1 << col))) {
+                continue;
+            }
+            for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
+                if (squares[mailbox_index(col, row)] != SQUARE_EMPTY) {
+                    continue;
+                }
+                if (piece_type == Shogi::PAWN && is_dead_end_row<S, KIND_PAWN>(row)) {
+                    continue;
+                }
+                if (piece_type == Shogi::LANCE && is_dead_end_row<S, KIND_LANCE>(row)) {
+                    continue;
+                }
+                if (piece_type == Shogi::KNIGHT && is_dead_end_row<S, KIND_KNIGHT>(row)) {
+                    continue;
+                }
+                moves.emplace_back(0, 0, col, row, piece_type, false, true, false);
             }
         }
     }
+}
+
+template <int S> void BoardState::generate_legal_moves(std::vector<Shogi::Move> &moves) const {
+    moves.clear();
+    generate_moves<S>(moves);
+
+    if (king_square(S) == NO_SQUARE) {
+        return;
+    }
+
+    // 王手とピンを一度だけ調べ、王手放置になる手を除外する
+    KingDanger danger;
+    compute_king_danger<S>(danger);
+
+    size_t legal_count = 0;
+    for (size_t i = 0; i < moves.size(); ++i) {
+        const Shogi::Move &move = moves[i];
+        if (!is_legal_pseudo_move<S>(move, danger)) {
+            continue;
+        }
+        // 打ち歩詰めは反則
+        if (move.is_drop && move.piece_type == Shogi::PAWN && is_pawn_drop_mate<S>(move.to_col, move.to_row)) {
+            continue;
+        }
+        moves[legal_count++] = move;
+    }
+    moves.resize(legal_count);
+}
 
-    return {-1, -1};
+void BoardState::generate_legal_moves(int side, std::vector<Shogi::Move> &moves) const {
+    if (side == Shogi::PLAYER) {
+        generate_legal_moves<Shogi::PLAYER>(moves);
+    } else {
+        generate_legal_moves<Shogi::ENEMY>(moves);
+    }
 }
 
-const Cell &BoardState::get_cell(int col, int row) const {
-    if (col < 0 || col >= Shogi::BOARD_COLS || row < 0 || row >= Shogi::BOARD_ROWS) {
-        // 範囲外のアクセスなら空のセルを返す
-        static Cell empty_cell;
-        return empty_cell;
+std::pair<int, int> BoardState::find_king_position(int side) const {
+    int king = king_square(side);
+    if (king == NO_SQUARE) {
+        return {-1, -1};
     }
+    return {king / MAILBOX_STRIDE - 1, king % MAILBOX_STRIDE - 1};
+}
 
-    return board[col * Shogi::BOARD_ROWS + row];
+void BoardState::get_king_danger(int side, KingDanger &danger) const {
+    if (side == Shogi::PLAYER) {
+        compute_king_danger<Shogi::PLAYER>(danger);
+    } else {
+        compute_king_danger<Shogi::ENEMY>(danger);
+    }
+}
+
+Cell BoardState::get_cell(int col, int row) const {
+    // 範囲外のアクセスなら空のセルを返す
+    if (!is_valid_coord(col, row)) {
+        return Cell();
+    }
+
+    uint8_t square = squares[mailbox_index(col, row)];
+    if (square == SQUARE_EMPTY) {
+        return Cell();
+    }
+    return Cell(square & SQUARE_TYPE_MASK, (square >> SQUARE_SIDE_SHIFT) & 1, (square & SQUARE_PROMOTED) != 0);
+}
+
+void BoardState::put_square(int col, int row, uint8_t square) {
+    int index = mailbox_index(col, row);
+    int key_index = col * Shogi::BOARD_ROWS + row;
+
+    uint8_t old = squares[index];
+    if (old != SQUARE_EMPTY) {
+        hash_key ^= Zobrist::piece_key(key_index, (old >> SQUARE_SIDE_SHIFT) & 1, (old & SQUARE_PROMOTED) != 0,
+                                       old & SQUARE_TYPE_MASK);
+    }
+    if (square != SQUARE_EMPTY) {
+        hash_key ^= Zobrist::piece_key(key_index, (square >> SQUARE_SIDE_SHIFT) & 1, (square & SQUARE_PROMOTED) != 0,
+                                       square & SQUARE_TYPE_MASK);
+    }
+    squares[index] = square;
+
+    // 玉の位置を追う
+    const uint8_t king_mask = static_cast<uint8_t>(~(1 << SQUARE_SIDE_SHIFT));
+    const uint8_t king = encode_square(Shogi::KING, Shogi::PLAYER, false);
+    if ((old & king_mask) == king && king_square((old >> SQUARE_SIDE_SHIFT) & 1) == index) {
+        set_king_square((old >> SQUARE_SIDE_SHIFT) & 1, NO_SQUARE);
+    }
+    if ((square & king_mask) == king) {
+        set_king_square((square >> SQUARE_SIDE_SHIFT) & 1, index);
+    }
 }
 
 void BoardState::set_cell(int col, int row, int type, int side, bool is_promoted) {
-    if (is_valid_coord(col, row)) {
-        int index = col * Shogi::BOARD_ROWS + row;
-        board[index] = Cell(type, side, is_promoted);
+    if (!is_valid_coord(col, row)) {
+        return;
+    }
+
+    if (type >= 0 && type < Shogi::PIECE_TYPE_COUNT) {
+        put_square(col, row, encode_square(type, side, is_promoted));
+    } else {
+        put_square(col, row, SQUARE_EMPTY);
     }
 }
 
 void BoardState::clear_cell(int col, int row) {
     if (is_valid_coord(col, row)) {
-        int index = col * Shogi::BOARD_ROWS + row;
-        board[index] = Cell();
+        put_square(col, row, SQUARE_EMPTY);
     }
 }
 
+void BoardState::add_hand(int side, int piece_type, int delta) {
+    int count = get_hand_count(side, piece_type);
+    int next = count + delta;
+    if (next < 0 || static_cast<uint32_t>(next) > HAND_MASK[piece_type]) {
+        return;
+    }
+
+    hash_key ^= Zobrist::hand_key(side, piece_type, count);
+    hash_key ^= Zobrist::hand_key(side, piece_type, next);
+    hand[side] = (hand[side] & ~(HAND_MASK[piece_type] << HAND_SHIFT[piece_type])) |
+                 (static_cast<uint32_t>(next) << HAND_SHIFT[piece_type]);
+}
+
+uint64_t BoardState::get_key(int side_to_move) const {
+    return side_to_move == Shogi::ENEMY ? (hash_key ^ Zobrist::side_key()) : hash_key;
+}
+
 int BoardState::get_hand_count(int side, int piece_type) const {
     if (side < 0 || side >= 2 || piece_type < 0 || piece_type >= Shogi::PIECE_TYPE_COUNT) {
         return 0;
     }
-    return hand[side][piece_type];
+    return (hand[side] >> HAND_SHIFT[piece_type]) & HAND_MASK[piece_type];
 }
 
 void BoardState::apply_move(const Shogi::Move &move, int side) {
+    UndoInfo undo;
+    apply_move(move, side, undo);
+}
+
+void BoardState::apply_move(const Shogi::Move &move, int side, UndoInfo &undo) {
+    undo = UndoInfo();
     if (move.is_drop) {
-        if (hand[side][move.piece_type] > 0) {
-            hand[side][move.piece_type]--;
+        if (get_hand_count(side, move.piece_type) > 0) {
+            add_hand(side, move.piece_type, -1);
+            undo.used_hand = true;
         }
 
-        set_cell(move.to_col, move.to_row, move.piece_type, side, false);
+        put_square(move.to_col, move.to_row, encode_square(move.piece_type, side, false));
     } else {
-        Cell source = get_cell(move.from_col, move.from_row);
-        Cell target = get_cell(move.to_col, move.to_row);
-        if (!target.is_empty()) {
-            int captured_type = target.type;
-            hand[side][captured_type]++;
+        uint8_t source = squares[mailbox_index(move.from_col, move.from_row)];
+        uint8_t target = squares[mailbox_index(move.to_col, move.to_row)];
+        if (target != SQUARE_EMPTY) {
+            add_hand(side, target & SQUARE_TYPE_MASK, 1);
         }
+        undo.source = source;
+        undo.captured = target;
 
-        bool is_promoted = move.is_promotion || source.is_promoted;
-        set_cell(move.to_col, move.to_row, source.type, side, is_promoted);
+        uint8_t moved = encode_square(source & SQUARE_TYPE_MASK, side,
+                                      move.is_promotion || (source & SQUARE_PROMOTED) != 0);
+        put_square(move.to_col, move.to_row, moved);
+        put_square(move.from_col, move.from_row, SQUARE_EMPTY);
+    }
+}
+
+void BoardState::undo_move(const Shogi::Move &move, int side, const UndoInfo &undo) {
+    // put_square と add_hand がハッシュ値と玉の位置も差分で戻す
+    if (move.is_drop) {
+        put_square(move.to_col, move.to_row, SQUARE_EMPTY);
+        if (undo.used_hand) {
+            add_hand(side, move.piece_type, 1);
+        }
+        return;
+    }
 
-        clear_cell(move.from_col, move.from_row);
+    put_square(move.from_col, move.from_row, undo.source);
+    put_square(move.to_col, move.to_row, undo.captured);
+    if (undo.captured != SQUARE_EMPTY) {
+        add_hand(side, undo.captured & SQUARE_TYPE_MASK, -1);
     }
 }
 
@@ -439,7 +1550,7 @@ void BoardState::print_board() const {
     for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
         String line = "";
         for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
-            const Cell &cell = get_cell(col, row);
+            Cell cell = get_cell(col, row);
             if (cell.is_empty()) {
                 line += ". ";
             } else {
@@ -459,12 +1570,12 @@ void BoardState::print_board() const {
     UtilityFunctions::print("Player Hand:");
     for (int piece_type = 0; piece_type < Shogi::PIECE_TYPE_COUNT; ++piece_type) {
         UtilityFunctions::print("Type " + String::num_int64(piece_type) + ": " +
-                                String::num_int64(hand[Shogi::PLAYER][piece_type]));
+                                String::num_int64(get_hand_count(Shogi::PLAYER, piece_type)));
     }
 
     UtilityFunctions::print("Enemy Hand:");
     for (int piece_type = 0; piece_type < Shogi::PIECE_TYPE_COUNT; ++piece_type) {
         UtilityFunctions::print("Type " + String::num_int64(piece_type) + ": " +
-                                String::num_int64(hand[Shogi::ENEMY][piece_type]));
+                                String::num_int64(get_hand_count(Shogi::ENEMY, piece_type)));
     }
 }
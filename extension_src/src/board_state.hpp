@@ -2,6 +2,7 @@
 #define BOARD_STATE_HPP
 
 #include <godot_cpp/classes/node2d.hpp>
+#include <string>
 #include <vector>
 
 #include "shogi_utils.hpp"
@@ -20,25 +21,128 @@ struct Cell {
 };
 
 class BoardState {
+  public:
+    // 盤面は筋ごとに番兵マス1つを挟んだ1次元配列（1マス1バイト）
+    // 上下左右の盤外はすべて番兵マスに当たるので、飛び駒の走査で範囲判定がいらない
+    static const int MAILBOX_STRIDE = Shogi::BOARD_ROWS + 1;
+    static const int MAILBOX_SIZE = 112; // (BOARD_COLS + 2) * MAILBOX_STRIDE + 1 を切り上げ
+
+    // 1マスの符号: 0 = 空き、WALL = 盤外、駒は PIECE | 手番 << 4 | 成り << 3 | 駒種
+    static const uint8_t SQUARE_EMPTY = 0x00;
+    static const uint8_t SQUARE_PIECE = 0x40;
+    static const uint8_t SQUARE_WALL = 0x80;
+    static const uint8_t SQUARE_PROMOTED = 0x08;
+    static const uint8_t SQUARE_TYPE_MASK = 0x07;
+    static const int SQUARE_SIDE_SHIFT = 4;
+
+    // 入玉宣言（27点法）の条件: 敵陣の駒の数と、敵陣の駒と持ち駒の点数（飛角5点、他1点）
+    static const int DECLARE_CAMP_PIECES = 10;
+    static const int DECLARE_POINTS_SENTE = 28;
+    static const int DECLARE_POINTS_GOTE = 27;
+
+    // pack_sfen の大きさ（256ビット）
+    static const int PACKED_SFEN_SIZE = 32;
+
+    // 玉がいないときの king_square（盤外の番兵マスなので玉の位置とは重ならない）
+    static const uint8_t NO_SQUARE = 0;
+
+    // 玉への王手とピンの状況（合法手の判定と評価関数の玉の安全度に使う）
+    struct KingDanger {
+        static const int MAX_PINS = 8;
+
+        int king_col = -1;
+        int king_row = -1;
+        int checker_count = 0;
+        int checker_col = -1; // 王手している駒（両王手なら最後に見つけたほう）
+        int checker_row = -1;
+        bool checker_is_distant = false; // 離れた飛び駒の王手（合い駒がきく）
+        int pin_count = 0;
+        int pinned_col[MAX_PINS];
+        int pinned_row[MAX_PINS];
+        int pin_dx[MAX_PINS]; // 玉からピンしている駒への向き
+        int pin_dy[MAX_PINS];
+    };
+
+    // apply_move で指した手を undo_move で戻すための情報
+    struct UndoInfo {
+        uint8_t source = SQUARE_EMPTY;   // 動かす前の駒（打つ手なら空き）
+        uint8_t captured = SQUARE_EMPTY; // 取った駒
+        bool used_hand = false;          // 持ち駒を減らしたか
+    };
+
   private:
-    Cell board[Shogi::BOARD_SIZE];
-    int hand[2][Shogi::PIECE_TYPE_COUNT];
+    alignas(64) uint8_t squares[MAILBOX_SIZE];
+    uint32_t hand[2];  // 駒種ごとの枚数と玉のマスを詰めたビットフィールド
+    uint64_t hash_key; // 盤面と持ち駒のZobristハッシュ（手番を含まない）
+
+    // 手番ごとの玉のマスは持ち駒のビットフィールドの空き（24〜30ビット）に置き、put_square で更新する
+    static const int KING_SQUARE_SHIFT = 24;
+    static const uint32_t KING_SQUARE_MASK = 0x7f;
+
+    int king_square(int side) const { return (hand[side] >> KING_SQUARE_SHIFT) & KING_SQUARE_MASK; }
+    void set_king_square(int side, int index) {
+        hand[side] = (hand[side] & ~(KING_SQUARE_MASK << KING_SQUARE_SHIFT)) |
+                     (static_cast<uint32_t>(index) << KING_SQUARE_SHIFT);
+    }
 
     // 座標が盤面内か
     static bool is_valid_coord(int col, int row) {
         return col >= 0 && col < Shogi::BOARD_COLS && row >= 0 && row < Shogi::BOARD_ROWS;
     }
 
+    static int mailbox_index(int col, int row) { return (col + 1) * MAILBOX_STRIDE + row + 1; }
+
+    static uint8_t encode_square(int type, int side, bool is_promoted) {
+        return static_cast<uint8_t>(SQUARE_PIECE | (side << SQUARE_SIDE_SHIFT) | (is_promoted ? SQUARE_PROMOTED : 0) |
+                                    (type & SQUARE_TYPE_MASK));
+    }
+
+    static uint8_t side_mask(int side) { return static_cast<uint8_t>(SQUARE_PIECE | (side << SQUARE_SIDE_SHIFT)); }
+
+    // 駒があり、その手番が side か
+    static bool is_side_square(uint8_t square, int side) {
+        return (square & (SQUARE_PIECE | SQUARE_WALL | (1 << SQUARE_SIDE_SHIFT))) == side_mask(side);
+    }
+
     bool is_valid_move(int from_col, int from_row, int to_col, int to_row) const;
+    // 敵陣にいる玉以外の駒の数と、その宣言の点数
+    void count_camp(int side, int &pieces, int &points) const;
     bool is_valid_drop(int piece_type, bool is_enemy, int to_col, int to_row) const;
     bool is_path_blocked(int from_col, int from_row, int to_col, int to_row) const;
     bool is_nifu(int piece_type, int side, int col) const;
-    std::pair<int, int> find_king_position(int side) const;
+    void add_hand(int side, int piece_type, int delta);
+    void put_square(int col, int row, uint8_t square);
+
+    // 手番・駒の動きの種類ごとにコンパイル時に特殊化した指し手生成
+    template <int S, int K>
+    void add_piece_moves(int from_col, int from_row, int to_col, int to_row, int piece_type, bool is_capture,
+                         std::vector<Shogi::Move> &moves) const;
+    template <int S, int K>
+    void generate_piece_moves(int col, int row, int piece_type, std::vector<Shogi::Move> &moves) const;
+    template <int S> void generate_moves(std::vector<Shogi::Move> &moves) const;
+    template <int S> void generate_legal_moves(std::vector<Shogi::Move> &moves) const;
+    // (col, row) に side A の駒の利きがあるか
+    template <int A> bool is_attacked_by(int col, int row) const;
+    template <int S> void compute_king_danger(KingDanger &danger) const;
+    // 疑似合法手が自玉を取られる形にならないか
+    template <int S> bool is_legal_pseudo_move(const Shogi::Move &move, const KingDanger &danger) const;
+    // side A の玉以外の駒で (col, row) の駒を取れるか（ピンを考慮）
+    template <int A> bool can_capture_without_king(int col, int row, const KingDanger &danger) const;
+    // side S が (col, row) に歩を打つと打ち歩詰めになるか
+    template <int S> bool is_pawn_drop_mate(int col, int row) const;
 
   public:
     BoardState();
 
     void init_from_main(Node *main_node);
+    void init_startpos();
+
+    // SFEN形式の局面（"startpos" も可）。手番は side_to_move に返す
+    bool set_sfen(const std::string &sfen, int &side_to_move);
+    std::string get_sfen(int side_to_move, int ply = 1) const;
+    // 駒40枚がそろった局面をハフマン符号で PACKED_SFEN_SIZE バイトに詰める（学習データ用）
+    bool pack_sfen(int side_to_move, uint8_t *out) const;
+    bool unpack_sfen(const uint8_t *data, int &side_to_move);
     bool is_legal_move(int from_col, int from_row, int to_col, int to_row) const;
     bool is_legal_drop(int piece_type, bool is_enemy, int to_col, int to_row) const;
     bool can_move_geometry(int piece_type, bool is_enemy, bool is_promoted, int from_col, int from_row, int to_col,
@@ -46,15 +150,38 @@ class BoardState {
     bool is_dead_end(int piece_type, bool is_enemy, int to_row) const;
     bool is_king_in_check(int side) const;
 
+    // 入玉
+    // 敵陣の駒は持たずに数える（玉が敵陣にいるときだけ数えれば足りるので、局面のコピーを大きくしない）
+    int get_impasse_points(int side) const;
+    int get_camp_piece_count(int side) const;
+    bool is_king_in_enemy_camp(int side) const;
+    // 玉が盤の中央より敵陣側へ進んだ段数（中央より自陣側や玉がいなければ 0）
+    int get_king_advance(int side) const;
+    // 玉が敵陣にいて王手されておらず、敵陣の駒と点数が足りていれば宣言で勝てる
+    bool can_declare_win(int side) const;
+    std::pair<int, int> find_king_position(int side) const;
+    void get_king_danger(int side, KingDanger &danger) const;
+
+    // side の合法手をすべて生成する（moves は上書きされる）
+    void generate_legal_moves(int side, std::vector<Shogi::Move> &moves) const;
+
     // 盤面の操作
-    const Cell &get_cell(int col, int row) const;
+    Cell get_cell(int col, int row) const;
     void set_cell(int col, int row, int type, int side, bool is_promoted);
     void clear_cell(int col, int row);
     int get_hand_count(int side, int piece_type) const;
     void apply_move(const Shogi::Move &move, int side);
+    void apply_move(const Shogi::Move &move, int side, UndoInfo &undo);
+    void undo_move(const Shogi::Move &move, int side, const UndoInfo &undo);
+
+    // 局面のハッシュ値（手番を含む）
+    uint64_t get_key(int side_to_move) const;
 
     // 盤面の出力（デバッグ用）
     void print_board() const;
 };
 
+// 探索は局面を値で渡すので、盤面・持ち駒・ハッシュ値をキャッシュライン2本に収める
+static_assert(sizeof(BoardState) == 128, "BoardState must stay within two cache lines");
+
 #endif
@@ -0,0 +1,144 @@
+#include "data_generator.hpp"
+#include "search_stack.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+namespace {
+
+// 詰みの評価値も int16 に収める
+const int MAX_PACKED_SCORE = 32000;
+
+} // namespace
+
+void DataGenerator::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("configure", "config"), &DataGenerator::configure);
+    ClassDB::bind_method(D_METHOD("generate", "path", "position_count", "threads", "seed"), &DataGenerator::generate,
+                         DEFVAL(0), DEFVAL(0));
+}
+
+DataGenerator::DataGenerator() {
+    // 既定は1局面あたり1ミリ秒に満たない浅い探索
+    limits.time_usec = 0;
+    limits.nodes = 0;
+    limits.depth = 2;
+}
+
+bool DataGenerator::configure(const Dictionary &config) {
+    SearchLimits next;
+    next.time_usec = 0;
+    next.nodes = static_cast<uint64_t>(static_cast<int64_t>(config.get("nodes", static_cast<int64_t>(limits.nodes))));
+    next.depth = config.get("depth", limits.depth);
+    if (next.nodes == 0 && next.depth <= 0) {
+        UtilityFunctions::printerr("DataGenerator: nodes or depth is required");
+        return false;
+    }
+
+    if (!SelfPlayGame::load_network(config, network)) {
+        return false;
+    }
+
+    limits = next;
+    hash_mb = std::max(1, static_cast<int>(config.get("hash_mb", hash_mb)));
+    random_plies = std::max(0, static_cast<int>(config.get("random_plies", random_plies)));
+    max_plies = std::max(1, static_cast<int>(config.get("max_plies", max_plies)));
+    eval_limit = std::max(1, static_cast<int>(config.get("eval_limit", eval_limit)));
+    return true;
+}
+
+void DataGenerator::play_game(std::mt19937_64 &rng, TranspositionTable &tt, SearchStack &stack,
+                              std::vector<SelfPlayGame::Ply> &plies, std::vector<PackedPosition> &positions) const {
+    BoardState board;
+    board.init_startpos();
+    tt.clear();
+
+    SelfPlayGame game;
+    game.max_plies = max_plies;
+    game.random_plies = random_plies;
+    game.eval_limit = eval_limit;
+    for (SelfPlayGame::Engine &engine : game.engines) {
+        engine.limits = limits;
+        engine.network = network;
+        engine.tt = &tt;
+    }
+    int winner = game.play(board, Shogi::PLAYER, &rng, stack, plies);
+
+    // 探索した局面を終局の結果とともに書く
+    for (size_t i = 0; i < plies.size(); ++i) {
+        const SelfPlayGame::Ply &ply = plies[i];
+        PackedPosition position = {};
+        if (!ply.searched || !ply.board.pack_sfen(ply.side, position.sfen)) {
+            continue;
+        }
+        int score = std::min(std::max(ply.score, -MAX_PACKED_SCORE), MAX_PACKED_SCORE);
+        position.score = static_cast<int16_t>(score);
+        position.move = Shogi::encode_move(ply.move);
+        position.ply = static_cast<uint16_t>(i + 1);
+        position.result = static_cast<int8_t>(winner < 0 ? 0 : (winner == ply.side ? 1 : -1));
+        positions.push_back(position);
+    }
+}
+
+Dictionary DataGenerator::generate(const String &path, int position_count, int threads, int seed) {
+    Dictionary result;
+    PackedPositionWriter writer;
+    if (position_count <= 0 || !writer.open(path)) {
+        return result;
+    }
+
+    ThreadPool pool(threads);
+    int thread_count = pool.get_thread_count();
+
+    std::atomic<int64_t> produced{0};
+    std::atomic<int64_t> games{0};
+    uint64_t start = Time::get_singleton()->get_ticks_usec();
+
+    pool.run(thread_count, [&](int task, int) {
+        std::mt19937_64 rng(static_cast<uint64_t>(seed) * 0x9E3779B97F4A7C15ULL + task);
+        TranspositionTable tt(hash_mb);
+        SearchStack stack;
+
+        std::vector<PackedPosition> buffer;
+        buffer.reserve(FLUSH_POSITIONS + max_plies);
+        std::vector<SelfPlayGame::Ply> plies;
+        plies.reserve(max_plies);
+        std::vector<PackedPosition> game;
+        game.reserve(max_plies);
+
+        while (produced.load(std::memory_order_relaxed) < position_count) {
+            game.clear();
+            play_game(rng, tt, stack, plies, game);
+            games.fetch_add(1, std::memory_order_relaxed);
+
+            // 要求数を超えた分は捨てる
+            int64_t begin = produced.fetch_add(static_cast<int64_t>(game.size()), std::memory_order_relaxed);
+            int64_t keep = std::min(static_cast<int64_t>(game.size()), std::max<int64_t>(0, position_count - begin));
+            buffer.insert(buffer.end(), game.begin(), game.begin() + keep);
+
+            if (buffer.size() >= static_cast<size_t>(FLUSH_POSITIONS)) {
+                // 同じ対局の局面が並ばないように混ぜてから書く
+                std::shuffle(buffer.begin(), buffer.end(), rng);
+                uint64_t written = writer.write(buffer);
+                buffer.clear();
+                UtilityFunctions::print("Positions ", static_cast<int64_t>(written), " / ", position_count);
+            }
+        }
+
+        std::shuffle(buffer.begin(), buffer.end(), rng);
+        writer.write(buffer);
+    });
+
+    uint64_t usec = Time::get_singleton()->get_ticks_usec() - start;
+    writer.close();
+
+    int64_t written = static_cast<int64_t>(writer.get_count());
+    result["positions"] = written;
+    result["games"] = games.load();
+    result["threads"] = thread_count;
+    result["usec"] = static_cast<int64_t>(usec);
+    result["positions_per_sec"] = usec > 0 ? written * 1000000 / static_cast<int64_t>(usec) : static_cast<int64_t>(0);
+    return result;
+}
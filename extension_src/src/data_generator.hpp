@@ -0,0 +1,51 @@
+#ifndef DATA_GENERATOR_HPP
+#define DATA_GENERATOR_HPP
+
+#include "ai_player.hpp"
+#include "nnue_evaluator.hpp"
+#include "packed_position.hpp"
+#include "self_play.hpp"
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace godot;
+
+// 自己対局で学習データを作る
+// 浅い探索で指し進めた局面を評価値・最善手・終局の結果とともに PackedPosition で書き出す。
+// スレッドごとに数十局分をためて混ぜてから書き足すので、メモリはファイルの大きさによらない
+class DataGenerator : public RefCounted {
+    GDCLASS(DataGenerator, RefCounted);
+
+  private:
+    // スレッドごとにためる局面数（混ぜる単位）
+    static const int FLUSH_POSITIONS = 1 << 13;
+
+    SearchLimits limits;
+    int hash_mb = 4;
+    int random_plies = 8; // 序盤をばらけさせるためにランダムに指す手数
+    int max_plies = 256;
+    int eval_limit = 3000; // 評価値の絶対値がこれを超えたら勝敗を決める
+    std::shared_ptr<const NNUE::Network> network;
+
+    // 1局指して局面を positions に加える（plies は指し手の作業領域）
+    void play_game(std::mt19937_64 &rng, TranspositionTable &tt, SearchStack &stack,
+                   std::vector<SelfPlayGame::Ply> &plies, std::vector<PackedPosition> &positions) const;
+
+  protected:
+    static void _bind_methods();
+
+  public:
+    DataGenerator();
+    ~DataGenerator() {}
+
+    // config のキー: nodes, depth, hash_mb, random_plies, max_plies, eval_limit, eval_network
+    bool configure(const Dictionary &config);
+
+    // position_count 局面を path に書く。seed が同じでもスレッドの進み方で並びは変わる
+    Dictionary generate(const String &path, int position_count, int threads, int seed);
+};
+
+#endif
@@ -0,0 +1,23 @@
+#include "eval_cache.hpp"
+
+EvalCache::EvalCache(int size_kb) {
+    if (size_kb < 1) {
+        size_kb = 1;
+    }
+
+    // エントリ数は2の累乗に切り詰める
+    uint64_t count = (static_cast<uint64_t>(size_kb) << 10) / sizeof(uint64_t);
+    uint64_t power = 1;
+    while (power * 2 <= count) {
+        power *= 2;
+    }
+
+    entries.assign(power, 0);
+    mask = power - 1;
+}
+
+void EvalCache::clear() {
+    for (uint64_t &entry : entries) {
+        entry = 0;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef EVAL_CACHE_HPP
+#define EVAL_CACHE_HPP
+
+#include <cstdint>
+#include <vector>
+
+// 静的評価値のキャッシュ（直接マップ方式）
+// 置換表とは別に、探索スレッドごとに持つ。評価値は手番側から見た値
+class EvalCache {
+  private:
+    // 上位32ビットにハッシュ値、下位32ビットに評価値を詰める
+    // 索引に使う下位ビットと合わせて照合する
+    std::vector<uint64_t> entries;
+    uint64_t mask = 0;
+
+  public:
+    explicit EvalCache(int size_kb = 64);
+
+    void clear();
+
+    bool probe(uint64_t key, int &score) const {
+        uint64_t entry = entries[key & mask];
+        if ((entry ^ key) >> 32 != 0 || entry == 0) {
+            return false;
+        }
+
+        score = static_cast<int32_t>(static_cast<uint32_t>(entry));
+        return true;
+    }
+
+    void store(uint64_t key, int score) {
+        entries[key & mask] = (key & 0xFFFFFFFF00000000ULL) | static_cast<uint32_t>(score);
+    }
+};
+
+#endif
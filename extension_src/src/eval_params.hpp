@@ -0,0 +1,38 @@
+#ifndef EVAL_PARAMS_HPP
+#define EVAL_PARAMS_HPP
+
+// 評価関数のパラメータ
+// EvalTuner（tools/tune_eval.gd）が書き出すファイル。手で直しても再調整で上書きされる
+namespace EvalParams {
+
+const int VAL_PAWN = 90;
+const int VAL_LANCE = 230;
+const int VAL_KNIGHT = 260;
+const int VAL_SILVER = 370;
+const int VAL_GOLD = 440;
+const int VAL_BISHOP = 570;
+const int VAL_ROOK = 640;
+const int VAL_PRO_PAWN = 530;
+const int VAL_PRO_LANCE = 490;
+const int VAL_PRO_KNIGHT = 510;
+const int VAL_PRO_SILVER = 500;
+const int VAL_PRO_BISHOP = 830;
+const int VAL_PRO_ROOK = 950;
+const int VAL_KING = 99999;
+
+// 入玉: 玉が盤の中央より敵陣側へ1段進むごとの加点（駒得評価のみ）
+const int ENTERING_KING_STEP = 20;
+// 入玉: 玉が敵陣にいるときの宣言の点数1点ごとの加点（駒得評価のみ）
+const int DECLARE_POINT_BONUS = 10;
+
+// 玉の安全度: 玉に王手している駒1枚ごとの点数（駒得評価のみ、負なら減点）
+const int KING_CHECKER = -50;
+// 玉の安全度: 玉にピンされている自分の駒1枚ごとの点数（駒得評価のみ、負なら減点）
+const int KING_PINNED_PIECE = -30;
+
+// 評価値を勝率に直すロジスティック関数の尺度
+const double WIN_RATE_SCALE = 3333.0;
+
+} // namespace EvalParams
+
+#endif
@@ -0,0 +1,419 @@
+#include "eval_tuner.hpp"
+#include "eval_params.hpp"
+#include "packed_position.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+namespace {
+
+const char *const PARAM_NAMES[EvalTuner::PARAM_COUNT] = {
+    "VAL_PAWN",     "VAL_LANCE",      "VAL_KNIGHT",     "VAL_SILVER",     "VAL_GOLD",
+    "VAL_BISHOP",   "VAL_ROOK",       "VAL_PRO_PAWN",   "VAL_PRO_LANCE",  "VAL_PRO_KNIGHT",
+    "VAL_PRO_SILVER", "VAL_PRO_BISHOP", "VAL_PRO_ROOK",   "ENTERING_KING_STEP", "DECLARE_POINT_BONUS",
+    "KING_CHECKER", "KING_PINNED_PIECE"};
+
+// eval_params.hpp でその定数の前に置く説明（null なら続けて書く）
+const char *const PARAM_COMMENTS[EvalTuner::PARAM_COUNT] = {
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    "入玉: 玉が盤の中央より敵陣側へ1段進むごとの加点（駒得評価のみ）",
+    "入玉: 玉が敵陣にいるときの宣言の点数1点ごとの加点（駒得評価のみ）",
+    "玉の安全度: 玉に王手している駒1枚ごとの点数（駒得評価のみ、負なら減点）",
+    "玉の安全度: 玉にピンされている自分の駒1枚ごとの点数（駒得評価のみ、負なら減点）"};
+
+const int INITIAL_VALUES[EvalTuner::PARAM_COUNT] = {
+    EvalParams::VAL_PAWN,       EvalParams::VAL_LANCE,      EvalParams::VAL_KNIGHT,     EvalParams::VAL_SILVER,
+    EvalParams::VAL_GOLD,       EvalParams::VAL_BISHOP,     EvalParams::VAL_ROOK,       EvalParams::VAL_PRO_PAWN,
+    EvalParams::VAL_PRO_LANCE,  EvalParams::VAL_PRO_KNIGHT, EvalParams::VAL_PRO_SILVER, EvalParams::VAL_PRO_BISHOP,
+    EvalParams::VAL_PRO_ROOK,   EvalParams::ENTERING_KING_STEP, EvalParams::DECLARE_POINT_BONUS,
+    EvalParams::KING_CHECKER,   EvalParams::KING_PINNED_PIECE};
+
+// 駒の種類（PieceType の順）から特徴量の番号へ。成れない駒は -1
+const int UNPROMOTED_PARAM[Shogi::PIECE_TYPE_COUNT] = {
+    -1, EvalTuner::PARAM_ROOK, EvalTuner::PARAM_BISHOP, EvalTuner::PARAM_GOLD, EvalTuner::PARAM_SILVER,
+    EvalTuner::PARAM_KNIGHT, EvalTuner::PARAM_LANCE, EvalTuner::PARAM_PAWN};
+const int PROMOTED_PARAM[Shogi::PIECE_TYPE_COUNT] = {
+    -1, EvalTuner::PARAM_PRO_ROOK, EvalTuner::PARAM_PRO_BISHOP, EvalTuner::PARAM_GOLD, EvalTuner::PARAM_PRO_SILVER,
+    EvalTuner::PARAM_PRO_KNIGHT, EvalTuner::PARAM_PRO_LANCE, EvalTuner::PARAM_PRO_PAWN};
+
+// 評価値を勝率に直すときの係数（10^(x/scale) = e^(x * LN10 / scale)）
+const double LN10 = 2.302585092994046;
+
+// 1チャンク分の部分和
+struct PartialSum {
+    double error = 0.0;
+    double gradient[EvalTuner::PARAM_COUNT] = {};
+};
+
+} // namespace
+
+void EvalTuner::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("load_positions", "path"), &EvalTuner::load_positions);
+    ClassDB::bind_method(D_METHOD("clear_positions"), &EvalTuner::clear_positions);
+    ClassDB::bind_method(D_METHOD("get_position_count"), &EvalTuner::get_position_count);
+    ClassDB::bind_method(D_METHOD("tune", "epochs", "threads", "learning_rate"), &EvalTuner::tune, DEFVAL(0),
+                         DEFVAL(2.0));
+    ClassDB::bind_method(D_METHOD("get_params"), &EvalTuner::get_params);
+    ClassDB::bind_method(D_METHOD("write_header", "path"), &EvalTuner::write_header);
+}
+
+EvalTuner::EvalTuner() : scale(EvalParams::WIN_RATE_SCALE) {
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        weights[i] = INITIAL_VALUES[i];
+    }
+}
+
+bool EvalTuner::parse_line(const String &line, int8_t (&row)[PARAM_COUNT], float &result) {
+    // 最後の空白より後ろが結果、前がSFEN
+    int64_t split = line.rfind(" ");
+    if (split <= 0) {
+        return false;
+    }
+
+    double value = line.substr(split + 1).to_float();
+    if (value < 0.0 || value > 1.0) {
+        return false;
+    }
+    result = static_cast<float>(value);
+
+    BoardState board;
+    int side;
+    if (!board.set_sfen(line.substr(0, split).utf8().get_data(), side)) {
+        return false;
+    }
+
+    extract_features(board, row);
+    return true;
+}
+
+void EvalTuner::extract_features(const BoardState &board, int8_t (&row)[PARAM_COUNT]) {
+    int counts[PARAM_COUNT] = {};
+    for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+        for (int row_index = 0; row_index < Shogi::BOARD_ROWS; ++row_index) {
+            Cell cell = board.get_cell(col, row_index);
+            if (cell.is_empty()) {
+                continue;
+            }
+            int param = cell.is_promoted ? PROMOTED_PARAM[cell.type] : UNPROMOTED_PARAM[cell.type];
+            if (param >= 0) {
+                counts[param] += (cell.side == Shogi::PLAYER) ? 1 : -1;
+            }
+        }
+    }
+
+    for (int type = 0; type < Shogi::PIECE_TYPE_COUNT; ++type) {
+        int param = UNPROMOTED_PARAM[type];
+        if (param >= 0) {
+            counts[param] += board.get_hand_count(Shogi::PLAYER, type) - board.get_hand_count(Shogi::ENEMY, type);
+        }
+    }
+
+    // 入玉（宣言の点数は高々 54 点なので int8_t に収まる）
+    for (int side = 0; side < 2; ++side) {
+        int sign = (side == Shogi::PLAYER) ? 1 : -1;
+        counts[PARAM_ENTERING_KING_STEP] += board.get_king_advance(side) * sign;
+        if (board.is_king_in_enemy_camp(side)) {
+            counts[PARAM_DECLARE_POINT_BONUS] += board.get_impasse_points(side) * sign;
+        }
+    }
+
+    // 玉の安全度
+    for (int side = 0; side < 2; ++side) {
+        int sign = (side == Shogi::PLAYER) ? 1 : -1;
+        BoardState::KingDanger danger;
+        board.get_king_danger(side, danger);
+        counts[PARAM_KING_CHECKER] += danger.checker_count * sign;
+        counts[PARAM_KING_PINNED_PIECE] += danger.pin_count * sign;
+    }
+
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        row[i] = static_cast<int8_t>(counts[i]);
+    }
+}
+
+void EvalTuner::add_position(const int8_t (&row)[PARAM_COUNT], float result) {
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        features[i].push_back(row[i]);
+    }
+    results.push_back(result);
+}
+
+int EvalTuner::load_packed_positions(const String &path) {
+    PackedPositionReader reader;
+    if (!reader.open(path)) {
+        return 0;
+    }
+
+    int loaded = 0;
+    int skipped = 0;
+    PackedPosition position;
+    while (reader.next(position)) {
+        BoardState board;
+        int side;
+        if (!board.unpack_sfen(position.sfen, side)) {
+            ++skipped;
+            continue;
+        }
+
+        // 手番側から見た結果を先手から見た 1 / 0.5 / 0 に直す
+        float result = (position.result + 1) * 0.5f;
+        if (side == Shogi::ENEMY) {
+            result = 1.0f - result;
+        }
+
+        int8_t row[PARAM_COUNT];
+        extract_features(board, row);
+        add_position(row, result);
+        ++loaded;
+    }
+
+    if (skipped > 0) {
+        UtilityFunctions::printerr("EvalTuner: skipped ", skipped, " invalid positions in ", path);
+    }
+    return loaded;
+}
+
+int EvalTuner::load_positions(const String &path) {
+    if (path.ends_with(".bin")) {
+        return load_packed_positions(path);
+    }
+
+    Ref<FileAccess> file = FileAccess::open(path, FileAccess::READ);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("EvalTuner: cannot open ", path);
+        return 0;
+    }
+
+    int loaded = 0;
+    int skipped = 0;
+    while (!file->eof_reached()) {
+        String line = file->get_line().strip_edges();
+        if (line.is_empty() || line.begins_with("#")) {
+            continue;
+        }
+
+        int8_t row[PARAM_COUNT];
+        float result;
+        if (!parse_line(line, row, result)) {
+            ++skipped;
+            continue;
+        }
+
+        add_position(row, result);
+        ++loaded;
+    }
+
+    if (skipped > 0) {
+        UtilityFunctions::printerr("EvalTuner: skipped ", skipped, " invalid lines in ", path);
+    }
+    return loaded;
+}
+
+void EvalTuner::clear_positions() {
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        features[i].clear();
+        features[i].shrink_to_fit();
+    }
+    results.clear();
+    results.shrink_to_fit();
+}
+
+int EvalTuner::get_position_count() const { return static_cast<int>(results.size()); }
+
+double EvalTuner::compute_loss(double p_scale, double *gradient, ThreadPool &pool) const {
+    int count = get_position_count();
+    int chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<PartialSum> partials(chunks);
+
+    const float k = static_cast<float>(LN10 / p_scale);
+    float w[PARAM_COUNT];
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        w[i] = static_cast<float>(weights[i]);
+    }
+
+    pool.run(chunks, [&](int chunk, int) {
+        int begin = chunk * CHUNK_SIZE;
+        int n = std::min(CHUNK_SIZE, count - begin);
+
+        // 特徴量ごとに連続した配列を舐めるので、内側のループはベクトル化される
+        std::vector<float> eval(n, 0.0f);
+        for (int f = 0; f < PARAM_COUNT; ++f) {
+            const int8_t *column = features[f].data() + begin;
+            const float weight = w[f];
+            for (int j = 0; j < n; ++j) {
+                eval[j] += weight * static_cast<float>(column[j]);
+            }
+        }
+
+        // eval を誤差項 (r - p) * p * (1 - p) で置き換える
+        const float *result = results.data() + begin;
+        double error = 0.0;
+        for (int j = 0; j < n; ++j) {
+            float p = 1.0f / (1.0f + std::exp(-k * eval[j]));
+            float diff = result[j] - p;
+            error += diff * diff;
+            eval[j] = diff * p * (1.0f - p);
+        }
+
+        PartialSum &partial = partials[chunk];
+        partial.error = error;
+        if (gradient != nullptr) {
+            for (int f = 0; f < PARAM_COUNT; ++f) {
+                const int8_t *column = features[f].data() + begin;
+                float sum = 0.0f;
+                for (int j = 0; j < n; ++j) {
+                    sum += eval[j] * static_cast<float>(column[j]);
+                }
+                partial.gradient[f] = sum;
+            }
+        }
+    });
+
+    // チャンク順に足すので、スレッド数によらず同じ値になる
+    double error = 0.0;
+    if (gradient != nullptr) {
+        std::fill(gradient, gradient + PARAM_COUNT, 0.0);
+    }
+    for (const PartialSum &partial : partials) {
+        error += partial.error;
+        if (gradient != nullptr) {
+            for (int f = 0; f < PARAM_COUNT; ++f) {
+                gradient[f] += partial.gradient[f];
+            }
+        }
+    }
+
+    if (gradient != nullptr) {
+        // d/dw (r - p)^2 = -2 (r - p) p (1 - p) k x
+        for (int f = 0; f < PARAM_COUNT; ++f) {
+            gradient[f] *= -2.0 * (LN10 / p_scale) / count;
+        }
+    }
+    return error / count;
+}
+
+double EvalTuner::tune_scale(ThreadPool &pool) {
+    // 黄金分割探索（誤差は尺度について単峰とみなす）
+    const double ratio = (std::sqrt(5.0) - 1.0) / 2.0;
+    double low = 100.0;
+    double high = 20000.0;
+
+    double x1 = high - ratio * (high - low);
+    double x2 = low + ratio * (high - low);
+    double f1 = compute_loss(x1, nullptr, pool);
+    double f2 = compute_loss(x2, nullptr, pool);
+
+    for (int i = 0; i < 40; ++i) {
+        if (f1 < f2) {
+            high = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = high - ratio * (high - low);
+            f1 = compute_loss(x1, nullptr, pool);
+        } else {
+            low = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = low + ratio * (high - low);
+            f2 = compute_loss(x2, nullptr, pool);
+        }
+    }
+
+    return (low + high) / 2.0;
+}
+
+Dictionary EvalTuner::tune(int epochs, int threads, double learning_rate) {
+    Dictionary result;
+    if (results.empty()) {
+        return result;
+    }
+
+    ThreadPool pool(threads);
+
+    double loss_before = compute_loss(scale, nullptr, pool);
+
+    // 尺度と重みは同時には決まらないので、先に今の重みで尺度を合わせ、以降は固定する
+    scale = tune_scale(pool);
+    UtilityFunctions::print("EvalTuner: ", get_position_count(), " positions, scale ", String::num(scale, 1),
+                            ", loss ", String::num(loss_before, 6), " -> ",
+                            String::num(compute_loss(scale, nullptr, pool), 6));
+
+    // Adam
+    const double beta1 = 0.9;
+    const double beta2 = 0.999;
+    const double epsilon = 1e-12;
+    double m[PARAM_COUNT] = {};
+    double v[PARAM_COUNT] = {};
+
+    double loss = 0.0;
+    for (int epoch = 1; epoch <= epochs; ++epoch) {
+        double gradient[PARAM_COUNT];
+        loss = compute_loss(scale, gradient, pool);
+
+        for (int i = 0; i < PARAM_COUNT; ++i) {
+            m[i] = beta1 * m[i] + (1.0 - beta1) * gradient[i];
+            v[i] = beta2 * v[i] + (1.0 - beta2) * gradient[i] * gradient[i];
+            double m_hat = m[i] / (1.0 - std::pow(beta1, epoch));
+            double v_hat = v[i] / (1.0 - std::pow(beta2, epoch));
+            weights[i] -= learning_rate * m_hat / (std::sqrt(v_hat) + epsilon);
+        }
+
+        if (epoch % 10 == 0 || epoch == epochs) {
+            UtilityFunctions::print("EvalTuner: epoch ", epoch, ", loss ", String::num(loss, 6));
+        }
+    }
+
+    result["loss_before"] = loss_before;
+    result["loss_after"] = compute_loss(scale, nullptr, pool);
+    result["params"] = get_params();
+    return result;
+}
+
+Dictionary EvalTuner::get_params() const {
+    Dictionary params;
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        params[PARAM_NAMES[i]] = static_cast<int>(std::lround(weights[i]));
+    }
+    params["WIN_RATE_SCALE"] = scale;
+    return params;
+}
+
+bool EvalTuner::write_header(const String &path) const {
+    Ref<FileAccess> file = FileAccess::open(path, FileAccess::WRITE);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("EvalTuner: cannot write ", path);
+        return false;
+    }
+
+    // eval_params.hpp と同じ体裁で書き出す
+    String text;
+    text += "#ifndef EVAL_PARAMS_HPP\n";
+    text += "#define EVAL_PARAMS_HPP\n\n";
+    text += "// 評価関数のパラメータ\n";
+    text += "// EvalTuner（tools/tune_eval.gd）が書き出すファイル。手で直しても再調整で上書きされる\n";
+    text += "namespace EvalParams {\n\n";
+    for (int i = 0; i < PARAM_COUNT; ++i) {
+        if (PARAM_COMMENTS[i] != nullptr) {
+            text += String("\n// ") + String::utf8(PARAM_COMMENTS[i]) + "\n";
+        }
+        text += String("const int ") + PARAM_NAMES[i] + " = " + String::num_int64(std::lround(weights[i])) + ";\n";
+        if (i == PARAM_PRO_ROOK) {
+            text += "const int VAL_KING = " + String::num_int64(EvalParams::VAL_KING) + ";\n";
+        }
+    }
+    text += "\n";
+    text += "// 評価値を勝率に直すロジスティック関数の尺度\n";
+    String scale_text = String::num(scale, 1);
+    if (!scale_text.contains(".")) {
+        scale_text += ".0";
+    }
+    text += "const double WIN_RATE_SCALE = " + scale_text + ";\n\n";
+    text += "} // namespace EvalParams\n\n";
+    text += "#endif\n";
+
+    file->store_string(text);
+    return true;
+}
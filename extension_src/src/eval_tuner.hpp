@@ -0,0 +1,80 @@
+#ifndef EVAL_TUNER_HPP
+#define EVAL_TUNER_HPP
+
+#include "board_state.hpp"
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <vector>
+
+using namespace godot;
+
+class ThreadPool;
+
+// 駒得評価のパラメータ調整（Texel方式）
+// 結果付きの局面を読み込み、評価値をロジスティック関数で勝率に直したときの二乗誤差を勾配法で最小化する
+class EvalTuner : public RefCounted {
+    GDCLASS(EvalTuner, RefCounted);
+
+  public:
+    // 調整する駒の価値（玉は除く）、入玉の加点、玉の安全度
+    enum Param {
+        PARAM_PAWN,
+        PARAM_LANCE,
+        PARAM_KNIGHT,
+        PARAM_SILVER,
+        PARAM_GOLD,
+        PARAM_BISHOP,
+        PARAM_ROOK,
+        PARAM_PRO_PAWN,
+        PARAM_PRO_LANCE,
+        PARAM_PRO_KNIGHT,
+        PARAM_PRO_SILVER,
+        PARAM_PRO_BISHOP,
+        PARAM_PRO_ROOK,
+        PARAM_ENTERING_KING_STEP,
+        PARAM_DECLARE_POINT_BONUS,
+        PARAM_KING_CHECKER,
+        PARAM_KING_PINNED_PIECE,
+        PARAM_COUNT
+    };
+
+  private:
+    // 1度に処理する局面数（スレッドへの分配単位）
+    static const int CHUNK_SIZE = 1 << 16;
+
+    // 局面は特徴量ごとの配列で持つ（先手の値 - 後手の値）
+    std::vector<int8_t> features[PARAM_COUNT];
+    std::vector<float> results; // 先手から見た結果（1 = 勝ち、0.5 = 引き分け、0 = 負け）
+
+    double weights[PARAM_COUNT];
+    double scale;
+
+    static void extract_features(const BoardState &board, int8_t (&row)[PARAM_COUNT]);
+    static bool parse_line(const String &line, int8_t (&row)[PARAM_COUNT], float &result);
+    void add_position(const int8_t (&row)[PARAM_COUNT], float result);
+    int load_packed_positions(const String &path);
+
+    // 平均二乗誤差。gradient が null でなければ重みについての勾配も求める
+    double compute_loss(double p_scale, double *gradient, ThreadPool &pool) const;
+    double tune_scale(ThreadPool &pool);
+
+  protected:
+    static void _bind_methods();
+
+  public:
+    EvalTuner();
+    ~EvalTuner() {}
+
+    // 1行に「SFEN 結果」（結果は先手から見た 1 / 0.5 / 0）のファイルを追加で読み込む
+    // 拡張子が .bin なら DataGenerator の書いた学習データとして読む
+    int load_positions(const String &path);
+    void clear_positions();
+    int get_position_count() const;
+
+    // 尺度を合わせてから重みを epochs 回更新する（Adam）
+    Dictionary tune(int epochs, int threads, double learning_rate);
+    Dictionary get_params() const;
+    bool write_header(const String &path) const;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "experience_store.hpp"
+#include "board_state.hpp"
+#include <algorithm>
+#include <cstring>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+namespace {
+
+const char FILE_MAGIC[4] = {'R', 'Y', 'E', 'X'};
+const uint32_t FILE_VERSION = 1;
+
+// ヘッダは magic, version, エントリ数, 平手の局面のハッシュ値
+const int64_t HEADER_SIZE = 4 + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+static_assert(sizeof(ExperienceStore::Entry) == 16, "experience file assumes 16-byte entries");
+
+// Zobrist の乱数が変わるとファイルのキーは意味を失うので、平手のハッシュ値で確かめる
+uint64_t startpos_key() {
+    BoardState board;
+    board.init_startpos();
+    return board.get_key(Shogi::PLAYER);
+}
+
+bool is_better(const ExperienceStore::Entry &a, const ExperienceStore::Entry &b) {
+    if (a.depth != b.depth) {
+        return a.depth > b.depth;
+    }
+    return a.bound() == TranspositionTable::BOUND_EXACT && b.bound() != TranspositionTable::BOUND_EXACT;
+}
+
+} // namespace
+
+ExperienceStore::ExperienceStore(std::vector<Entry> p_entries) : entries(std::move(p_entries)) {
+    // 世代は持ち越さない
+    for (Entry &entry : entries) {
+        entry.bound_generation &= 0x3;
+    }
+
+    // キー順に並べ、同じキーは良いほうを先頭に置いて残りを消す
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.key != b.key ? a.key < b.key : is_better(a, b);
+    });
+    entries.erase(std::unique(entries.begin(), entries.end(),
+                              [](const Entry &a, const Entry &b) { return a.key == b.key; }),
+                  entries.end());
+
+    if (entries.size() > static_cast<size_t>(MAX_ENTRIES)) {
+        std::nth_element(entries.begin(), entries.begin() + MAX_ENTRIES, entries.end(),
+                         [](const Entry &a, const Entry &b) { return a.depth > b.depth; });
+        entries.resize(MAX_ENTRIES);
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.key < b.key; });
+    }
+}
+
+bool ExperienceStore::load(const String &path) {
+    PackedByteArray bytes = FileAccess::get_file_as_bytes(path);
+    if (bytes.size() < HEADER_SIZE) {
+        UtilityFunctions::printerr("Experience: cannot read ", path);
+        return false;
+    }
+
+    const uint8_t *data = bytes.ptr();
+    uint32_t header[2];
+    uint64_t key_check;
+    std::memcpy(header, data + 4, sizeof(header));
+    std::memcpy(&key_check, data + 4 + sizeof(header), sizeof(key_check));
+    if (std::memcmp(data, FILE_MAGIC, 4) != 0 || header[0] != FILE_VERSION || key_check != startpos_key()) {
+        UtilityFunctions::printerr("Experience: incompatible file: ", path);
+        return false;
+    }
+    if (bytes.size() != HEADER_SIZE + static_cast<int64_t>(header[1] * sizeof(Entry))) {
+        UtilityFunctions::printerr("Experience: unexpected file size: ", path);
+        return false;
+    }
+
+    // リトルエンディアンのまま並べてあるので一度にコピーする
+    std::vector<Entry> loaded(header[1]);
+    std::memcpy(loaded.data(), data + HEADER_SIZE, loaded.size() * sizeof(Entry));
+    *this = ExperienceStore(std::move(loaded));
+    return true;
+}
+
+bool ExperienceStore::save(const String &path) const {
+    PackedByteArray bytes;
+    bytes.resize(HEADER_SIZE + static_cast<int64_t>(entries.size() * sizeof(Entry)));
+
+    uint8_t *data = bytes.ptrw();
+    uint32_t header[2] = {FILE_VERSION, static_cast<uint32_t>(entries.size())};
+    uint64_t key_check = startpos_key();
+    std::memcpy(data, FILE_MAGIC, 4);
+    std::memcpy(data + 4, header, sizeof(header));
+    std::memcpy(data + 4 + sizeof(header), &key_check, sizeof(key_check));
+    std::memcpy(data + HEADER_SIZE, entries.data(), entries.size() * sizeof(Entry));
+
+    Ref<FileAccess> file = FileAccess::open(path, FileAccess::WRITE);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("Experience: cannot write ", path);
+        return false;
+    }
+    file->store_buffer(bytes);
+    return true;
+}
+
+bool ExperienceStore::probe(uint64_t key, Entry &entry) const {
+    auto it = std::lower_bound(entries.begin(), entries.end(), key,
+                               [](const Entry &a, uint64_t k) { return a.key < k; });
+    if (it == entries.end() || it->key != key) {
+        return false;
+    }
+
+    entry = *it;
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef EXPERIENCE_STORE_HPP
+#define EXPERIENCE_STORE_HPP
+
+#include "transposition_table.hpp"
+#include <cstdint>
+#include <godot_cpp/variant/string.hpp>
+#include <vector>
+
+using namespace godot;
+
+// 対局をまたいで残す深い探索結果（置換表の2段目として引く）
+// ファイルはキー順に並べたエントリの配列。起動時に一度に読み込み、二分探索で引く
+class ExperienceStore {
+  public:
+    using Entry = TranspositionTable::Entry;
+
+    // 残り深さがこれ以上の結果だけを残す
+    static const int MIN_DEPTH = 4;
+    // 残すエントリ数の上限（1エントリ16バイトで4MB）。超えたら浅いものから捨てる
+    static const int MAX_ENTRIES = 1 << 18;
+
+  private:
+    std::vector<Entry> entries; // キー順
+
+  public:
+    ExperienceStore() = default;
+    // 同じキーは深い結果を残し、MAX_ENTRIES に収める
+    explicit ExperienceStore(std::vector<Entry> p_entries);
+
+    bool load(const String &path);
+    // 別スレッドから呼んでよい（書き出し中に entries は変わらない）
+    bool save(const String &path) const;
+
+    // 見つかれば true を返し、entry に内容を書き込む
+    bool probe(uint64_t key, Entry &entry) const;
+    int size() const { return static_cast<int>(entries.size()); }
+    const std::vector<Entry> &get_entries() const { return entries; }
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "game_analyzer.hpp"
+#include "ai_player.hpp"
+#include <algorithm>
+#include <godot_cpp/variant/utility_functions.hpp>
+#include <thread>
+
+using namespace godot;
+
+namespace {
+
+// 解析スレッドごとの置換表サイズ
+const int ANALYSIS_HASH_MB = 8;
+
+} // namespace
+
+bool GameAnalyzer::parse_move(const BoardState &board, int side, const Dictionary &data, Shogi::Move &move) {
+    bool is_drop = data.get("is_drop", false);
+    int to_col = data.get("to_col", -1);
+    int to_row = data.get("to_row", -1);
+    int piece_type = data.get("piece_type", -1);
+    bool is_promotion = data.get("is_promotion", false);
+    bool is_enemy = (side == Shogi::ENEMY);
+
+    if (is_drop) {
+        if (is_promotion || !board.is_legal_drop(piece_type, is_enemy, to_col, to_row)) {
+            return false;
+        }
+
+        move = Shogi::Move(0, 0, to_col, to_row, piece_type, false, true, false);
+        return true;
+    }
+
+    int from_col = data.get("from_col", -1);
+    int from_row = data.get("from_row", -1);
+    if (!board.is_legal_move(from_col, from_row, to_col, to_row)) {
+        return false;
+    }
+
+    Cell piece = board.get_cell(from_col, from_row);
+    if (piece.side != side) {
+        return false;
+    }
+
+    // 成れない手の成り、行き所のない不成を弾く
+    if (is_promotion) {
+        int zone_min = is_enemy ? 6 : 0;
+        int zone_max = is_enemy ? 8 : 2;
+        bool in_zone = (from_row >= zone_min && from_row <= zone_max) || (to_row >= zone_min && to_row <= zone_max);
+        if (!in_zone || piece.is_promoted || piece.type == Shogi::KING || piece.type == Shogi::GOLD) {
+            return false;
+        }
+    } else if (!piece.is_promoted && board.is_dead_end(piece.type, is_enemy, to_row)) {
+        return false;
+    }
+
+    bool is_capture = !board.get_cell(to_col, to_row).is_empty();
+    move = Shogi::Move(from_col, from_row, to_col, to_row, piece.type, is_promotion, false, is_capture);
+    return true;
+}
+
+bool GameAnalyzer::load_moves(const Array &move_list) {
+    positions.clear();
+    moves.clear();
+    keys.clear();
+    checks.clear();
+
+    BoardState board;
+    board.init_startpos();
+
+    for (int ply = 0;; ++ply) {
+        int side = side_to_move(ply);
+        positions.push_back(board);
+        keys.push_back(board.get_key(side));
+        checks.push_back(board.is_king_in_check(side));
+
+        if (ply >= move_list.size()) {
+            break;
+        }
+
+        Shogi::Move move;
+        if (!parse_move(board, side, move_list[ply], move)) {
+            UtilityFunctions::printerr("GameAnalyzer: illegal move at ply ", ply + 1);
+            return false;
+        }
+
+        moves.push_back(move);
+        board.apply_move(move, side);
+    }
+
+    return true;
+}
+
+void GameAnalyzer::analyze_range(int begin, int end, uint64_t nodes_per_position) {
+    TranspositionTable tt(ANALYSIS_HASH_MB);
+    SearchStack stack;
+
+    SearchLimits limits;
+    limits.time_usec = 0;
+    limits.nodes = nodes_per_position;
+
+    PositionHistory history;
+    AIPlayer ai_player(false, history, tt);
+    ai_player.set_search_stack(&stack);
+
+    // 終局側から読むと、後の局面の結果が置換表経由で前の局面の探索に効く
+    for (int ply = end - 1; ply >= begin; --ply) {
+        int side = side_to_move(ply);
+
+        history.clear();
+        for (int i = 0; i <= ply; ++i) {
+            history.push(keys[i], checks[i]);
+        }
+
+        ai_player.reset(side == Shogi::ENEMY, history);
+        ai_player.set_limits(limits);
+        ai_player.set_verbose(false);
+
+        const std::vector<AIPlayer::RootMove> &root_moves = ai_player.search_root(positions[ply], 1);
+
+        PositionResult &result = results[ply];
+        if (root_moves.empty()) {
+            // 指す手がない（詰み）か、入玉宣言で勝ち
+            result.score = ai_player.is_declaring_win() ? 999999 : -999999;
+            result.has_best_move = false;
+        } else {
+            result.score = root_moves[0].score;
+            result.has_best_move = true;
+            result.best_move = root_moves[0].move;
+        }
+    }
+}
+
+void GameAnalyzer::run(uint64_t nodes_per_position, int thread_count) {
+    int count = static_cast<int>(positions.size());
+    results.assign(count, PositionResult());
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    thread_count = 1;
+#else
+    if (thread_count <= 0) {
+        thread_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+#endif
+    thread_count = std::max(1, std::min(thread_count, count));
+
+    if (thread_count == 1) {
+        analyze_range(0, count, nodes_per_position);
+        return;
+    }
+
+    // 連続した区間ごとにスレッドへ割り当てる（区間内は後ろから読む）
+    std::vector<std::thread> workers;
+    int chunk = (count + thread_count - 1) / thread_count;
+    for (int begin = 0; begin < count; begin += chunk) {
+        int end = std::min(count, begin + chunk);
+        workers.emplace_back(&GameAnalyzer::analyze_range, this, begin, end, nodes_per_position);
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+Dictionary GameAnalyzer::get_result(double blunder_threshold) const {
+    int count = static_cast<int>(results.size());
+
+    PackedInt32Array scores;
+    Array best_moves;
+    PackedFloat32Array win_rate_losses;
+    Array blunders;
+
+    for (int ply = 0; ply < count; ++ply) {
+        // 先手から見た評価値
+        int score = results[ply].score;
+        scores.append(side_to_move(ply) == Shogi::PLAYER ? score : -score);
+
+        if (results[ply].has_best_move) {
+            best_moves.append(AIPlayer::move_to_dictionary(results[ply].best_move));
+        } else {
+            best_moves.append(Dictionary());
+        }
+    }
+
+    for (int ply = 0; ply + 1 < count; ++ply) {
+        // 指した側から見た、指す前と指した後の勝率の差
+        double before = AIPlayer::calculate_win_probability(results[ply].score);
+        double after = AIPlayer::calculate_win_probability(-results[ply + 1].score);
+        double loss = std::max(0.0, before - after);
+
+        bool is_best = results[ply].has_best_move &&
+                       Shogi::encode_move(results[ply].best_move) == Shogi::encode_move(moves[ply]);
+
+        win_rate_losses.append(static_cast<float>(loss));
+        blunders.append(!is_best && loss >= blunder_threshold);
+    }
+
+    Dictionary result;
+    result["scores"] = scores;
+    result["best_moves"] = best_moves;
+    result["win_rate_losses"] = win_rate_losses;
+    result["blunders"] = blunders;
+    return result;
+}
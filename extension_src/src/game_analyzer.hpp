@@ -0,0 +1,41 @@
+#ifndef GAME_ANALYZER_HPP
+#define GAME_ANALYZER_HPP
+
+#include "board_state.hpp"
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <vector>
+
+using namespace godot;
+
+// 棋譜の一括解析
+// 各局面を一定のノード数で探索し、手ごとの評価値と悪手判定を返す
+class GameAnalyzer {
+  private:
+    struct PositionResult {
+        int score = 0; // 手番側から見た評価値
+        bool has_best_move = false;
+        Shogi::Move best_move;
+    };
+
+    std::vector<BoardState> positions; // positions[i] は i 手目を指す前の局面
+    std::vector<Shogi::Move> moves;
+    std::vector<uint64_t> keys;
+    std::vector<bool> checks;
+    std::vector<PositionResult> results;
+
+    static int side_to_move(int ply) { return (ply % 2 == 0) ? Shogi::PLAYER : Shogi::ENEMY; }
+
+    void analyze_range(int begin, int end, uint64_t nodes_per_position);
+
+  public:
+    // MoveRecord.to_dictionary() の形式の指し手を読む。side の合法手でなければ false
+    static bool parse_move(const BoardState &board, int side, const Dictionary &data, Shogi::Move &move);
+
+    // 平手の開始局面から moves を順に適用する。不正な手があれば false
+    bool load_moves(const Array &move_list);
+    void run(uint64_t nodes_per_position, int thread_count);
+    Dictionary get_result(double blunder_threshold) const;
+};
+
+#endif
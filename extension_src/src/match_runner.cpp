@@ -0,0 +1,255 @@
+#include "match_runner.hpp"
+#include "self_play.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+namespace {
+
+// 得点率からElo差へ
+double score_to_elo(double score) {
+    score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+double elo_to_score(double elo) { return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0)); }
+
+} // namespace
+
+void MatchRunner::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("configure_engine", "index", "config"), &MatchRunner::configure_engine);
+    ClassDB::bind_method(D_METHOD("load_openings", "path"), &MatchRunner::load_openings);
+    ClassDB::bind_method(D_METHOD("set_openings", "sfens"), &MatchRunner::set_openings);
+    ClassDB::bind_method(D_METHOD("set_sprt", "elo0", "elo1", "alpha", "beta"), &MatchRunner::set_sprt,
+                         DEFVAL(0.05), DEFVAL(0.05));
+    ClassDB::bind_method(D_METHOD("set_max_plies", "plies"), &MatchRunner::set_max_plies);
+    ClassDB::bind_method(D_METHOD("run", "games", "threads"), &MatchRunner::run, DEFVAL(0));
+}
+
+MatchRunner::MatchRunner() {
+    // 既定は固定ノード数（時間より再現性が高い）
+    for (int i = 0; i < 2; ++i) {
+        engines[i].name = (i == 0) ? "A" : "B";
+        engines[i].limits.time_usec = 0;
+        engines[i].limits.nodes = 100000;
+    }
+}
+
+bool MatchRunner::configure_engine(int index, const Dictionary &config) {
+    if (index < 0 || index > 1) {
+        return false;
+    }
+
+    EngineConfig engine;
+    engine.name = config.get("name", engines[index].name);
+    engine.limits.time_usec = static_cast<uint64_t>(static_cast<int64_t>(config.get("time_msec", 0))) * 1000;
+    engine.limits.nodes = static_cast<uint64_t>(static_cast<int64_t>(config.get("nodes", 0)));
+    engine.limits.depth = config.get("depth", engine.limits.depth);
+    engine.hash_mb = config.get("hash_mb", engine.hash_mb);
+
+    if (engine.limits.time_usec == 0 && engine.limits.nodes == 0) {
+        engine.limits.nodes = 100000;
+    }
+
+    if (!SelfPlayGame::load_network(config, engine.network)) {
+        return false;
+    }
+
+    engines[index] = engine;
+    return true;
+}
+
+int MatchRunner::load_openings(const String &path) {
+    if (!FileAccess::file_exists(path)) {
+        UtilityFunctions::printerr("MatchRunner: opening file not found: ", path);
+        return 0;
+    }
+
+    PackedStringArray lines = FileAccess::get_file_as_string(path).split("\n");
+    PackedStringArray sfens;
+    for (int i = 0; i < lines.size(); ++i) {
+        String line = lines[i].strip_edges();
+        if (line.is_empty() || line.begins_with("#")) {
+            continue;
+        }
+        sfens.append(line);
+    }
+
+    set_openings(sfens);
+    return static_cast<int>(openings.size());
+}
+
+void MatchRunner::set_openings(const PackedStringArray &sfens) {
+    openings.clear();
+
+    for (int i = 0; i < sfens.size(); ++i) {
+        std::string sfen = sfens[i].utf8().get_data();
+
+        BoardState board;
+        int side;
+        if (!board.set_sfen(sfen, side)) {
+            UtilityFunctions::printerr("MatchRunner: invalid SFEN: ", sfens[i]);
+            continue;
+        }
+        openings.push_back(sfen);
+    }
+}
+
+void MatchRunner::set_sprt(double elo0, double elo1, double alpha, double beta) {
+    sprt_elo0 = elo0;
+    sprt_elo1 = elo1;
+    sprt_alpha = alpha;
+    sprt_beta = beta;
+}
+
+void MatchRunner::set_max_plies(int plies) { max_plies = std::max(1, plies); }
+
+MatchRunner::GameResult MatchRunner::play_game(const std::string &opening, bool a_is_sente) const {
+    BoardState board;
+    int side;
+    if (!board.set_sfen(opening, side)) {
+        board.init_startpos();
+        side = Shogi::PLAYER;
+    }
+
+    // エンジンごとに置換表を持つ（局の間は使い回さない）
+    TranspositionTable tables[2] = {TranspositionTable(engines[0].hash_mb), TranspositionTable(engines[1].hash_mb)};
+    SearchStack stack;
+
+    SelfPlayGame game;
+    game.max_plies = max_plies;
+    int a_side = a_is_sente ? Shogi::PLAYER : Shogi::ENEMY;
+    for (int engine = 0; engine < 2; ++engine) {
+        SelfPlayGame::Engine &player = game.engines[engine == 0 ? a_side : 1 - a_side];
+        player.limits = engines[engine].limits;
+        player.network = engines[engine].network;
+        player.tt = &tables[engine];
+    }
+
+    std::vector<SelfPlayGame::Ply> plies;
+    int winner = game.play(board, side, nullptr, stack, plies);
+
+    GameResult result;
+    result.score = (winner < 0) ? 1 : (winner == a_side ? 2 : 0);
+    result.plies = static_cast<int>(plies.size());
+    for (const SelfPlayGame::Ply &ply : plies) {
+        int engine = (ply.side == a_side) ? 0 : 1;
+        result.nodes[engine] += ply.nodes;
+        result.usec[engine] += ply.usec;
+        result.depth_sum[engine] += ply.depth;
+        result.moves[engine]++;
+    }
+    return result;
+}
+
+Dictionary MatchRunner::run(int games, int threads) {
+    if (openings.empty()) {
+        openings.push_back("startpos");
+    }
+
+    ThreadPool pool(threads);
+
+    // 先後を入れ替えた2局を組にして、スレッド数の倍ずつ指す
+    int batch = std::max(2, pool.get_thread_count() * 2);
+
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+    uint64_t nodes[2] = {0, 0};
+    uint64_t usec[2] = {0, 0};
+    uint64_t depth_sum[2] = {0, 0};
+    uint64_t moves[2] = {0, 0};
+    uint64_t plies = 0;
+
+    double lower_bound = std::log(sprt_beta / (1.0 - sprt_alpha));
+    double upper_bound = std::log((1.0 - sprt_beta) / sprt_alpha);
+    double llr = 0.0;
+    double elo = 0.0;
+    double elo_error = 0.0;
+    String sprt_result;
+
+    int played = 0;
+    while (played < games && sprt_result.is_empty()) {
+        int count = std::min(batch, games - played);
+        int base = played;
+        std::vector<GameResult> results(count);
+
+        pool.run(count, [&](int task, int) {
+            int game = base + task;
+            const std::string &opening = openings[(game / 2) % openings.size()];
+            results[task] = play_game(opening, game % 2 == 0);
+        });
+
+        // 集計は対局番号順
+        for (const GameResult &result : results) {
+            if (result.score == 2) {
+                ++wins;
+            } else if (result.score == 1) {
+                ++draws;
+            } else {
+                ++losses;
+            }
+            for (int i = 0; i < 2; ++i) {
+                nodes[i] += result.nodes[i];
+                usec[i] += result.usec[i];
+                depth_sum[i] += result.depth_sum[i];
+                moves[i] += result.moves[i];
+            }
+            plies += result.plies;
+        }
+        played += count;
+
+        // 1局ごとの得点（1, 0.5, 0）の平均と分散
+        double n = static_cast<double>(played);
+        double mean = (wins + 0.5 * draws) / n;
+        double variance =
+            (wins * std::pow(1.0 - mean, 2) + draws * std::pow(0.5 - mean, 2) + losses * std::pow(mean, 2)) / n;
+
+        elo = score_to_elo(mean);
+        double margin = 1.96 * std::sqrt(variance / n);
+        elo_error = (score_to_elo(mean + margin) - score_to_elo(mean - margin)) / 2.0;
+
+        // 正規近似のGSPRT
+        if (variance > 0.0) {
+            double s0 = elo_to_score(sprt_elo0);
+            double s1 = elo_to_score(sprt_elo1);
+            llr = n * (s1 - s0) * (2.0 * mean - s0 - s1) / (2.0 * variance);
+        }
+        if (llr >= upper_bound) {
+            sprt_result = "H1";
+        } else if (llr <= lower_bound) {
+            sprt_result = "H0";
+        }
+
+        UtilityFunctions::print("Games ", played, ": +", wins, " =", draws, " -", losses, "  Elo ",
+                                String::num(elo, 1), " +/- ", String::num(elo_error, 1), "  LLR ", String::num(llr, 2),
+                                " [", String::num(lower_bound, 2), ", ", String::num(upper_bound, 2), "]");
+    }
+
+    Dictionary result;
+    result["games"] = played;
+    result["wins"] = wins;
+    result["draws"] = draws;
+    result["losses"] = losses;
+    result["elo"] = elo;
+    result["elo_error"] = elo_error;
+    result["llr"] = llr;
+    result["sprt"] = sprt_result;
+    result["average_plies"] = played > 0 ? static_cast<double>(plies) / played : 0.0;
+
+    Array engine_stats;
+    for (int i = 0; i < 2; ++i) {
+        Dictionary stats;
+        stats["name"] = engines[i].name;
+        stats["nps"] = usec[i] > 0 ? static_cast<int64_t>(nodes[i] * 1000000 / usec[i]) : static_cast<int64_t>(0);
+        stats["average_depth"] = moves[i] > 0 ? static_cast<double>(depth_sum[i]) / moves[i] : 0.0;
+        stats["nodes"] = static_cast<int64_t>(nodes[i]);
+        engine_stats.append(stats);
+    }
+    result["engines"] = engine_stats;
+
+    return result;
+}
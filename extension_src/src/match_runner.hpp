@@ -0,0 +1,68 @@
+#ifndef MATCH_RUNNER_HPP
+#define MATCH_RUNNER_HPP
+
+#include "ai_player.hpp"
+#include "nnue_evaluator.hpp"
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace godot;
+
+// 2つのエンジン設定の自己対局
+// 開始局面集の各局面を先後入れ替えて指し、Elo差・SPRT・NPS・平均深さを集計する
+class MatchRunner : public RefCounted {
+    GDCLASS(MatchRunner, RefCounted);
+
+  private:
+    struct EngineConfig {
+        String name;
+        SearchLimits limits;
+        int hash_mb = 16;
+        std::shared_ptr<const NNUE::Network> network;
+    };
+
+    // 1局の結果（index 0 がエンジンA）
+    struct GameResult {
+        int score = 1; // Aから見て 2 = 勝ち、1 = 引き分け、0 = 負け
+        int plies = 0;
+        uint64_t nodes[2] = {0, 0};
+        uint64_t usec[2] = {0, 0};
+        uint64_t depth_sum[2] = {0, 0};
+        int moves[2] = {0, 0};
+    };
+
+    EngineConfig engines[2];
+    std::vector<std::string> openings;
+    int max_plies = 320;
+
+    double sprt_elo0 = 0.0;
+    double sprt_elo1 = 5.0;
+    double sprt_alpha = 0.05;
+    double sprt_beta = 0.05;
+
+    GameResult play_game(const std::string &opening, bool a_is_sente) const;
+
+  protected:
+    static void _bind_methods();
+
+  public:
+    MatchRunner();
+    ~MatchRunner() {}
+
+    // config のキー: name, nodes, time_msec, depth, hash_mb, eval_network（空なら駒得評価）
+    bool configure_engine(int index, const Dictionary &config);
+    // 1行1局面のSFENファイル。読み込んだ局面数を返す
+    int load_openings(const String &path);
+    void set_openings(const PackedStringArray &sfens);
+    void set_sprt(double elo0, double elo1, double alpha, double beta);
+    void set_max_plies(int plies);
+
+    // 最大 games 局を threads 並列で指す（SPRTで決着すれば途中で止める）
+    Dictionary run(int games, int threads);
+};
+
+#endif
@@ -0,0 +1,315 @@
+#include "nnue_evaluator.hpp"
+#include "nnue_kernels.hpp"
+#include <algorithm>
+#include <cstring>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+using namespace godot;
+
+namespace {
+
+// 駒種ごとの成駒の種類番号（成れない駒は -1）
+const int PROMOTED_KIND[Shogi::PIECE_TYPE_COUNT] = {-1, 7, 8, -1, 9, 10, 11, 12};
+
+// 持ち駒の特徴量の開始位置と最大枚数
+const int HAND_OFFSET[Shogi::PIECE_TYPE_COUNT] = {0, 0, 2, 4, 8, 12, 16, 20};
+const int HAND_MAX_COUNT[Shogi::PIECE_TYPE_COUNT] = {0, 2, 2, 4, 4, 4, 4, 18};
+
+const int HAND_BASE = 2 * NNUE::BOARD_PIECE_KINDS * Shogi::BOARD_SIZE;
+const int KING_BASE = HAND_BASE + 2 * NNUE::HAND_FEATURES;
+
+const char FILE_MAGIC[4] = {'R', 'Y', 'N', 'N'};
+const uint32_t FILE_VERSION = 1;
+
+// 後手から見るときは盤を180度回す
+int orient(int perspective, int index) {
+    return perspective == Shogi::PLAYER ? index : Shogi::BOARD_SIZE - 1 - index;
+}
+
+int king_bucket(int perspective, int king_index) {
+    if (king_index < 0) {
+        return 0;
+    }
+
+    int oriented = orient(perspective, king_index);
+    int col = oriented / Shogi::BOARD_ROWS;
+    int row = oriented % Shogi::BOARD_ROWS;
+    return (col / 3) * 3 + row / 3;
+}
+
+int feature_index(int perspective, int bucket, const NNUE::FeatureChange &change) {
+    int enemy_offset = (change.side == perspective) ? 0 : 1;
+    int local;
+
+    switch (change.kind) {
+    case NNUE::FeatureChange::BOARD_PIECE: {
+        int kind = change.is_promoted ? PROMOTED_KIND[change.piece_type] : change.piece_type - 1;
+        if (kind < 0) {
+            return -1;
+        }
+        local = (enemy_offset * NNUE::BOARD_PIECE_KINDS + kind) * Shogi::BOARD_SIZE + orient(perspective, change.index);
+        break;
+    }
+    case NNUE::FeatureChange::HAND_PIECE:
+        if (change.index >= HAND_MAX_COUNT[change.piece_type]) {
+            return -1;
+        }
+        local = HAND_BASE + enemy_offset * NNUE::HAND_FEATURES + HAND_OFFSET[change.piece_type] + change.index;
+        break;
+    case NNUE::FeatureChange::KING:
+        // 自玉は領域として扱うので、特徴量になるのは相手玉だけ
+        if (enemy_offset == 0) {
+            return -1;
+        }
+        local = KING_BASE + orient(perspective, change.index);
+        break;
+    default:
+        return -1;
+    }
+
+    return bucket * NNUE::FEATURES_PER_BUCKET + local;
+}
+
+int king_index_of(const BoardState &board, int side) {
+    std::pair<int, int> king = board.find_king_position(side);
+    if (king.first < 0) {
+        return -1;
+    }
+    return king.first * Shogi::BOARD_ROWS + king.second;
+}
+
+// 全結合層 + clipped ReLU
+template <int IN, int OUT>
+void affine_layer(const NNUE::Kernels &kernels, const uint8_t *input, const int8_t (*weights)[IN],
+                  const int32_t *biases, uint8_t *output) {
+    for (int i = 0; i < OUT; ++i) {
+        int32_t value = (biases[i] + kernels.dot_product(input, weights[i], IN)) >> NNUE::WEIGHT_SHIFT;
+        output[i] = static_cast<uint8_t>(std::min(127, std::max(0, value)));
+    }
+}
+
+} // namespace
+
+namespace NNUE {
+
+bool Network::load(const String &path) {
+    PackedByteArray bytes = FileAccess::get_file_as_bytes(path);
+
+    const int64_t header_size = 4 + 5 * sizeof(uint32_t);
+    const int64_t body_size = sizeof(feature_biases) + sizeof(int16_t) * static_cast<int64_t>(INPUT_DIMENSIONS) * L1 +
+                              sizeof(l1_biases) + sizeof(l1_weights) + sizeof(l2_biases) + sizeof(l2_weights) +
+                              sizeof(output_bias) + sizeof(output_weights);
+
+    if (bytes.size() != header_size + body_size) {
+        UtilityFunctions::printerr("NNUE: unexpected file size: ", path);
+        return false;
+    }
+
+    const uint8_t *data = bytes.ptr();
+    uint32_t header[5];
+    std::memcpy(header, data + 4, sizeof(header));
+    if (std::memcmp(data, FILE_MAGIC, 4) != 0 || header[0] != FILE_VERSION || header[1] != INPUT_DIMENSIONS ||
+        header[2] != L1 || header[3] != L2 || header[4] != L3) {
+        UtilityFunctions::printerr("NNUE: incompatible network file: ", path);
+        return false;
+    }
+
+    // リトルエンディアンのまま並べてあるので順にコピーする
+    const uint8_t *cursor = data + header_size;
+    auto read = [&cursor](void *dest, size_t size) {
+        std::memcpy(dest, cursor, size);
+        cursor += size;
+    };
+
+    feature_weights.resize(static_cast<size_t>(INPUT_DIMENSIONS) * L1);
+    read(feature_biases, sizeof(feature_biases));
+    read(feature_weights.data(), feature_weights.size() * sizeof(int16_t));
+    read(l1_biases, sizeof(l1_biases));
+    read(l1_weights, sizeof(l1_weights));
+    read(l2_biases, sizeof(l2_biases));
+    read(l2_weights, sizeof(l2_weights));
+    read(&output_bias, sizeof(output_bias));
+    read(output_weights, sizeof(output_weights));
+
+    return true;
+}
+
+AccumulatorStack::AccumulatorStack(std::shared_ptr<const Network> p_network)
+    : network(std::move(p_network)), kernels(&select_kernels()), entries(MAX_PLY + 1) {}
+
+void AccumulatorStack::refresh(const BoardState &board, int perspective, Entry &entry) const {
+    int bucket = king_bucket(perspective, king_index_of(board, perspective));
+    int16_t *values = entry.values[perspective];
+    std::memcpy(values, network->feature_biases, sizeof(network->feature_biases));
+
+    for (int col = 0; col < Shogi::BOARD_COLS; ++col) {
+        for (int row = 0; row < Shogi::BOARD_ROWS; ++row) {
+            Cell cell = board.get_cell(col, row);
+            if (cell.is_empty()) {
+                continue;
+            }
+
+            FeatureChange change;
+            change.kind = (cell.type == Shogi::KING) ? FeatureChange::KING : FeatureChange::BOARD_PIECE;
+            change.side = static_cast<uint8_t>(cell.side);
+            change.piece_type = static_cast<uint8_t>(cell.type);
+            change.is_promoted = cell.is_promoted;
+            change.index = static_cast<uint8_t>(col * Shogi::BOARD_ROWS + row);
+
+            int index = feature_index(perspective, bucket, change);
+            if (index >= 0) {
+                kernels->add_weights(values, &network->feature_weights[static_cast<size_t>(index) * L1]);
+            }
+        }
+    }
+
+    for (int side = 0; side < 2; ++side) {
+        for (int piece_type = Shogi::ROOK; piece_type < Shogi::PIECE_TYPE_COUNT; ++piece_type) {
+            int count = board.get_hand_count(side, piece_type);
+            for (int i = 0; i < count; ++i) {
+                FeatureChange change{FeatureChange::HAND_PIECE, static_cast<uint8_t>(side),
+                                     static_cast<uint8_t>(piece_type), false, static_cast<uint8_t>(i)};
+                int index = feature_index(perspective, bucket, change);
+                if (index >= 0) {
+                    kernels->add_weights(values, &network->feature_weights[static_cast<size_t>(index) * L1]);
+                }
+            }
+        }
+    }
+
+    entry.computed[perspective] = true;
+}
+
+void AccumulatorStack::update(const Entry &from, Entry &to, int perspective, int bucket) const {
+    int16_t *values = to.values[perspective];
+    std::memcpy(values, from.values[perspective], sizeof(to.values[perspective]));
+
+    for (int i = 0; i < to.removed_count; ++i) {
+        int index = feature_index(perspective, bucket, to.removed[i]);
+        if (index >= 0) {
+            kernels->sub_weights(values, &network->feature_weights[static_cast<size_t>(index) * L1]);
+        }
+    }
+
+    for (int i = 0; i < to.added_count; ++i) {
+        int index = feature_index(perspective, bucket, to.added[i]);
+        if (index >= 0) {
+            kernels->add_weights(values, &network->feature_weights[static_cast<size_t>(index) * L1]);
+        }
+    }
+
+    to.computed[perspective] = true;
+}
+
+void AccumulatorStack::reset(const BoardState &board) {
+    top = 0;
+    Entry &entry = entries[0];
+    entry.removed_count = 0;
+    entry.added_count = 0;
+    entry.king_moved[0] = entry.king_moved[1] = false;
+    refresh(board, Shogi::PLAYER, entry);
+    refresh(board, Shogi::ENEMY, entry);
+}
+
+void AccumulatorStack::push(const BoardState &board, const Shogi::Move &move, int side) {
+    if (top + 1 >= static_cast<int>(entries.size())) {
+        entries.resize(entries.size() * 2);
+    }
+
+    Entry &entry = entries[++top];
+    entry.computed[0] = entry.computed[1] = false;
+    entry.king_moved[0] = entry.king_moved[1] = false;
+    entry.removed_count = 0;
+    entry.added_count = 0;
+
+    uint8_t to_index = static_cast<uint8_t>(move.to_col * Shogi::BOARD_ROWS + move.to_row);
+
+    if (move.is_drop) {
+        int count = board.get_hand_count(side, move.piece_type);
+        entry.removed[entry.removed_count++] = {FeatureChange::HAND_PIECE, static_cast<uint8_t>(side), move.piece_type,
+                                                false, static_cast<uint8_t>(count - 1)};
+        entry.added[entry.added_count++] = {FeatureChange::BOARD_PIECE, static_cast<uint8_t>(side), move.piece_type,
+                                            false, to_index};
+        return;
+    }
+
+    Cell piece = board.get_cell(move.from_col, move.from_row);
+    uint8_t from_index = static_cast<uint8_t>(move.from_col * Shogi::BOARD_ROWS + move.from_row);
+
+    if (piece.type == Shogi::KING) {
+        entry.king_moved[side] = true;
+        entry.removed[entry.removed_count++] = {FeatureChange::KING, static_cast<uint8_t>(side), Shogi::KING, false,
+                                                from_index};
+        entry.added[entry.added_count++] = {FeatureChange::KING, static_cast<uint8_t>(side), Shogi::KING, false,
+                                            to_index};
+    } else {
+        entry.removed[entry.removed_count++] = {FeatureChange::BOARD_PIECE, static_cast<uint8_t>(side),
+                                                static_cast<uint8_t>(piece.type), piece.is_promoted, from_index};
+        entry.added[entry.added_count++] = {FeatureChange::BOARD_PIECE, static_cast<uint8_t>(side),
+                                            static_cast<uint8_t>(piece.type),
+                                            piece.is_promoted || move.is_promotion, to_index};
+    }
+
+    Cell target = board.get_cell(move.to_col, move.to_row);
+    if (!target.is_empty()) {
+        int count = board.get_hand_count(side, target.type);
+        entry.removed[entry.removed_count++] = {FeatureChange::BOARD_PIECE, static_cast<uint8_t>(target.side),
+                                                static_cast<uint8_t>(target.type), target.is_promoted, to_index};
+        entry.added[entry.added_count++] = {FeatureChange::HAND_PIECE, static_cast<uint8_t>(side),
+                                            static_cast<uint8_t>(target.type), false, static_cast<uint8_t>(count)};
+    }
+}
+
+void AccumulatorStack::pop() {
+    if (top > 0) {
+        --top;
+    }
+}
+
+int AccumulatorStack::evaluate(const BoardState &board, int side_to_move) {
+    // 計算済みの祖先から差分を順に適用する（途中で玉が動いていれば作り直す）
+    for (int perspective = 0; perspective < 2; ++perspective) {
+        int start = top;
+        bool needs_refresh = false;
+        while (!entries[start].computed[perspective]) {
+            if (entries[start].king_moved[perspective] || start == 0) {
+                needs_refresh = true;
+                break;
+            }
+            --start;
+        }
+
+        if (needs_refresh) {
+            refresh(board, perspective, entries[top]);
+            continue;
+        }
+
+        int bucket = king_bucket(perspective, king_index_of(board, perspective));
+        for (int ply = start + 1; ply <= top; ++ply) {
+            update(entries[ply - 1], entries[ply], perspective, bucket);
+        }
+    }
+
+    const Entry &entry = entries[top];
+    int opponent = (side_to_move == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+
+    alignas(32) uint8_t input[2 * L1];
+    alignas(32) uint8_t hidden1[L2];
+    alignas(32) uint8_t hidden2[L3];
+
+    kernels->clipped_relu(entry.values[side_to_move], input, L1);
+    kernels->clipped_relu(entry.values[opponent], input + L1, L1);
+
+    affine_layer<2 * L1, L2>(*kernels, input, network->l1_weights, network->l1_biases, hidden1);
+    affine_layer<L2, L3>(*kernels, hidden1, network->l2_weights, network->l2_biases, hidden2);
+
+    int32_t output = network->output_bias;
+    for (int i = 0; i < L3; ++i) {
+        output += static_cast<int32_t>(hidden2[i]) * network->output_weights[i];
+    }
+
+    return output / OUTPUT_SCALE;
+}
+
+} // namespace NNUE
@@ -0,0 +1,105 @@
+#ifndef NNUE_EVALUATOR_HPP
+#define NNUE_EVALUATOR_HPP
+
+#include "board_state.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// NNUE（差分計算可能なニューラルネットワーク）による評価関数
+//
+// 入力は手番側・相手側それぞれの玉の位置（3x3の領域）ごとの駒配置と持ち駒の特徴量。
+// 第1層の出力（アキュムレータ）は指し手ごとに差分更新し、以降は int8 の量子化層で計算する。
+namespace NNUE {
+
+struct Kernels;
+
+// 玉の領域数
+const int KING_BUCKETS = 9;
+
+// 盤上の駒の種類（玉以外の7種 + 成駒6種）
+const int BOARD_PIECE_KINDS = 13;
+
+// 持ち駒の特徴量数（飛2 角2 金4 銀4 桂4 香4 歩18）
+const int HAND_FEATURES = 38;
+
+const int FEATURES_PER_BUCKET = 2 * BOARD_PIECE_KINDS * Shogi::BOARD_SIZE + 2 * HAND_FEATURES + Shogi::BOARD_SIZE;
+const int INPUT_DIMENSIONS = KING_BUCKETS * FEATURES_PER_BUCKET;
+
+// 各層の次元
+const int L1 = 128;
+const int L2 = 32;
+const int L3 = 32;
+
+// 出力を評価値（歩 = 90 前後）に直す除数
+const int OUTPUT_SCALE = 16;
+
+// 量子化した中間層の右シフト量
+const int WEIGHT_SHIFT = 6;
+
+// 探索の最大手数
+const int MAX_PLY = 128;
+
+struct Network {
+    alignas(32) int16_t feature_biases[L1];
+    std::vector<int16_t> feature_weights; // [INPUT_DIMENSIONS][L1]
+
+    alignas(32) int32_t l1_biases[L2];
+    alignas(32) int8_t l1_weights[L2][2 * L1];
+    alignas(32) int32_t l2_biases[L3];
+    alignas(32) int8_t l2_weights[L3][L2];
+    int32_t output_bias;
+    alignas(32) int8_t output_weights[L3];
+
+    // res:// などのパスからバイナリの重みファイルを読み込む
+    bool load(const String &path);
+};
+
+// 盤面の変化1つ分（特徴量の追加・削除の単位）
+struct FeatureChange {
+    enum Kind : uint8_t { BOARD_PIECE, HAND_PIECE, KING };
+
+    Kind kind;
+    uint8_t side;
+    uint8_t piece_type;
+    bool is_promoted;
+    uint8_t index; // 盤上ならマス番号、持ち駒なら何枚目か（0始まり）
+};
+
+// 探索スレッドごとのアキュムレータのスタック
+class AccumulatorStack {
+  private:
+    struct Entry {
+        alignas(32) int16_t values[2][L1];
+        bool computed[2];
+        bool king_moved[2];
+        int removed_count;
+        int added_count;
+        FeatureChange removed[3];
+        FeatureChange added[3];
+    };
+
+    std::shared_ptr<const Network> network;
+    const Kernels *kernels; // 起動時に選んだ命令セットの実装
+    std::vector<Entry> entries;
+    int top = 0;
+
+    void refresh(const BoardState &board, int perspective, Entry &entry) const;
+    void update(const Entry &from, Entry &to, int perspective, int bucket) const;
+
+  public:
+    explicit AccumulatorStack(std::shared_ptr<const Network> p_network);
+
+    // 探索開始局面で初期化する
+    void reset(const BoardState &board);
+    // board で side が move を指したときの差分を積む（board は指す前の局面）
+    void push(const BoardState &board, const Shogi::Move &move, int side);
+    void pop();
+
+    // 手番側から見た評価値
+    int evaluate(const BoardState &board, int side_to_move);
+};
+
+} // namespace NNUE
+
+#endif
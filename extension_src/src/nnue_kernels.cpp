@@ -0,0 +1,251 @@
+#include "nnue_kernels.hpp"
+#include "nnue_evaluator.hpp"
+#include <algorithm>
+
+// どの CPU でも動く実装（x86_64 は SSE2、arm64 は NEON、Web は SIMD128、それ以外はスカラー）
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// SConstruct が命令セット別の翻訳単位を加えたときだけ CPUID で選ぶ
+#if defined(SHOGI_DISPATCH_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+void add_weights(int16_t *accumulator, const int16_t *weights) {
+#if defined(__SSE2__) || defined(_M_X64)
+    for (int i = 0; i < NNUE::L1; i += 8) {
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i *>(accumulator + i));
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(weights + i));
+        _mm_store_si128(reinterpret_cast<__m128i *>(accumulator + i), _mm_add_epi16(a, w));
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    for (int i = 0; i < NNUE::L1; i += 8) {
+        vst1q_s16(accumulator + i, vaddq_s16(vld1q_s16(accumulator + i), vld1q_s16(weights + i)));
+    }
+#elif defined(__wasm_simd128__)
+    for (int i = 0; i < NNUE::L1; i += 8) {
+        v128_t a = wasm_v128_load(accumulator + i);
+        v128_t w = wasm_v128_load(weights + i);
+        wasm_v128_store(accumulator + i, wasm_i16x8_add(a, w));
+    }
+#else
+    for (int i = 0; i < NNUE::L1; ++i) {
+        accumulator[i] += weights[i];
+    }
+#endif
+}
+
+void sub_weights(int16_t *accumulator, const int16_t *weights) {
+#if defined(__SSE2__) || defined(_M_X64)
+    for (int i = 0; i < NNUE::L1; i += 8) {
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i *>(accumulator + i));
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(weights + i));
+        _mm_store_si128(reinterpret_cast<__m128i *>(accumulator + i), _mm_sub_epi16(a, w));
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    for (int i = 0; i < NNUE::L1; i += 8) {
+        vst1q_s16(accumulator + i, vsubq_s16(vld1q_s16(accumulator + i), vld1q_s16(weights + i)));
+    }
+#elif defined(__wasm_simd128__)
+    for (int i = 0; i < NNUE::L1; i += 8) {
+        v128_t a = wasm_v128_load(accumulator + i);
+        v128_t w = wasm_v128_load(weights + i);
+        wasm_v128_store(accumulator + i, wasm_i16x8_sub(a, w));
+    }
+#else
+    for (int i = 0; i < NNUE::L1; ++i) {
+        accumulator[i] -= weights[i];
+    }
+#endif
+}
+
+void clipped_relu(const int16_t *input, uint8_t *output, int size) {
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i limit = _mm_set1_epi8(127);
+    for (int i = 0; i < size; i += 16) {
+        __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i *>(input + i));
+        __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i *>(input + i + 8));
+        __m128i packed = _mm_min_epu8(_mm_packus_epi16(lo, hi), limit);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), packed);
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    const uint8x16_t limit = vdupq_n_u8(127);
+    for (int i = 0; i < size; i += 16) {
+        uint8x16_t packed = vcombine_u8(vqmovun_s16(vld1q_s16(input + i)), vqmovun_s16(vld1q_s16(input + i + 8)));
+        vst1q_u8(output + i, vminq_u8(packed, limit));
+    }
+#elif defined(__wasm_simd128__)
+    const v128_t limit = wasm_u8x16_splat(127);
+    for (int i = 0; i < size; i += 16) {
+        v128_t lo = wasm_v128_load(input + i);
+        v128_t hi = wasm_v128_load(input + i + 8);
+        wasm_v128_store(output + i, wasm_u8x16_min(wasm_u8x16_narrow_i16x8(lo, hi), limit));
+    }
+#else
+    for (int i = 0; i < size; ++i) {
+        output[i] = static_cast<uint8_t>(std::min<int>(127, std::max<int>(0, input[i])));
+    }
+#endif
+}
+
+int32_t dot_product(const uint8_t *input, const int8_t *weights, int size) {
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < size; i += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i));
+        __m128i w = _mm_load_si128(reinterpret_cast<const __m128i *>(weights + i));
+        // 符号なし/符号付きをそれぞれ16ビットに広げて積和
+        __m128i in_lo = _mm_unpacklo_epi8(in, zero);
+        __m128i in_hi = _mm_unpackhi_epi8(in, zero);
+        __m128i w_lo = _mm_srai_epi16(_mm_unpacklo_epi8(w, w), 8);
+        __m128i w_hi = _mm_srai_epi16(_mm_unpackhi_epi8(w, w), 8);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(in_lo, w_lo));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(in_hi, w_hi));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    // 入力は 127 以下なので符号付き16ビットに広げても値は変わらない
+    int32x4_t sum = vdupq_n_s32(0);
+    for (int i = 0; i < size; i += 16) {
+        uint8x16_t in = vld1q_u8(input + i);
+        int8x16_t w = vld1q_s8(weights + i);
+        int16x8_t in_lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(in)));
+        int16x8_t in_hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(in)));
+        int16x8_t w_lo = vmovl_s8(vget_low_s8(w));
+        int16x8_t w_hi = vmovl_s8(vget_high_s8(w));
+        sum = vmlal_s16(sum, vget_low_s16(in_lo), vget_low_s16(w_lo));
+        sum = vmlal_s16(sum, vget_high_s16(in_lo), vget_high_s16(w_lo));
+        sum = vmlal_s16(sum, vget_low_s16(in_hi), vget_low_s16(w_hi));
+        sum = vmlal_s16(sum, vget_high_s16(in_hi), vget_high_s16(w_hi));
+    }
+    return vaddvq_s32(sum);
+#elif defined(__wasm_simd128__)
+    v128_t sum = wasm_i32x4_splat(0);
+    for (int i = 0; i < size; i += 16) {
+        v128_t in = wasm_v128_load(input + i);
+        v128_t w = wasm_v128_load(weights + i);
+        sum = wasm_i32x4_add(sum, wasm_i32x4_dot_i16x8(wasm_u16x8_extend_low_u8x16(in),
+                                                       wasm_i16x8_extend_low_i8x16(w)));
+        sum = wasm_i32x4_add(sum, wasm_i32x4_dot_i16x8(wasm_u16x8_extend_high_u8x16(in),
+                                                       wasm_i16x8_extend_high_i8x16(w)));
+    }
+    return wasm_i32x4_extract_lane(sum, 0) + wasm_i32x4_extract_lane(sum, 1) + wasm_i32x4_extract_lane(sum, 2) +
+           wasm_i32x4_extract_lane(sum, 3);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < size; ++i) {
+        sum += static_cast<int32_t>(input[i]) * weights[i];
+    }
+    return sum;
+#endif
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+const char BASELINE_NAME[] = "sse2";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+const char BASELINE_NAME[] = "neon";
+#elif defined(__wasm_simd128__)
+const char BASELINE_NAME[] = "simd128";
+#else
+const char BASELINE_NAME[] = "scalar";
+#endif
+
+const NNUE::Kernels BASELINE_KERNELS = {BASELINE_NAME, add_weights, sub_weights, clipped_relu, dot_product};
+
+#if defined(SHOGI_DISPATCH_X86)
+struct CpuFeatures {
+    bool sse42 = false;
+    bool avx2 = false;
+    bool bmi2 = false;
+};
+
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t (&regs)[4]) {
+#if defined(_MSC_VER)
+    int values[4];
+    __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; ++i) {
+        regs[i] = static_cast<uint32_t>(values[i]);
+    }
+#else
+    if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3])) {
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    }
+#endif
+}
+
+// OS が YMM レジスタを保存するか（XCR0 の SSE と AVX の状態）
+bool os_saves_ymm() {
+#if defined(_MSC_VER)
+    return (_xgetbv(0) & 0x6) == 0x6;
+#else
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (eax & 0x6) == 0x6;
+#endif
+}
+
+CpuFeatures detect_cpu() {
+    CpuFeatures features;
+    uint32_t regs[4];
+
+    cpuid(0, 0, regs);
+    uint32_t max_leaf = regs[0];
+
+    cpuid(1, 0, regs);
+    features.sse42 = (regs[2] >> 20) & 1;
+    bool avx = ((regs[2] >> 28) & 1) && ((regs[2] >> 27) & 1) && os_saves_ymm();
+
+    if (max_leaf >= 7) {
+        cpuid(7, 0, regs);
+        features.avx2 = avx && ((regs[1] >> 5) & 1);
+        features.bmi2 = (regs[1] >> 8) & 1;
+    }
+    return features;
+}
+#endif
+
+const NNUE::Kernels *detect_kernels() {
+#if defined(SHOGI_DISPATCH_X86)
+    CpuFeatures features = detect_cpu();
+    // AVX2 の翻訳単位は BMI2 も有効にしてビルドするので両方そろったときだけ使う
+    if (features.avx2 && features.bmi2 && NNUE::avx2_kernels() != nullptr) {
+        return NNUE::avx2_kernels();
+    }
+    if (features.sse42 && NNUE::sse42_kernels() != nullptr) {
+        return NNUE::sse42_kernels();
+    }
+#endif
+    return &BASELINE_KERNELS;
+}
+
+} // namespace
+
+namespace NNUE {
+
+const Kernels &select_kernels() {
+    static const Kernels *selected = detect_kernels();
+    return *selected;
+}
+
+const Kernels *baseline_kernels() { return &BASELINE_KERNELS; }
+
+#if !defined(SHOGI_DISPATCH_X86)
+const Kernels *sse42_kernels() { return nullptr; }
+const Kernels *avx2_kernels() { return nullptr; }
+#endif
+
+} // namespace NNUE
@@ -0,0 +1,32 @@
+#ifndef NNUE_KERNELS_HPP
+#define NNUE_KERNELS_HPP
+
+#include <cstdint>
+
+namespace NNUE {
+
+// NNUE の演算カーネル（命令セットごとの実装を1つにまとめたもの）
+// x86_64 では AVX2 / SSE4.2 の実装を別の翻訳単位で専用の命令セットを有効にしてビルドし、
+// 起動後に CPUID で対応を調べて選ぶ。1つのバイナリでどの CPU でも動き、新しい CPU では速い実装を使う
+struct Kernels {
+    const char *name;
+    // アキュムレータ（L1 要素）に重みの1行を足す・引く
+    void (*add_weights)(int16_t *accumulator, const int16_t *weights);
+    void (*sub_weights)(int16_t *accumulator, const int16_t *weights);
+    // int16 を [0, 127] に丸めて uint8 にする（size は16の倍数）
+    void (*clipped_relu)(const int16_t *input, uint8_t *output, int size);
+    // uint8 の入力と int8 の重みの内積（size は32の倍数、weights は32バイト境界）
+    int32_t (*dot_product)(const uint8_t *input, const int8_t *weights, int size);
+};
+
+// この CPU で使える中で最も速い実装（初回の呼び出しで決める）
+const Kernels &select_kernels();
+
+// 命令セットごとの実装。ビルドに含まれていなければ nullptr（CPU の対応は select_kernels が調べる）
+const Kernels *baseline_kernels();
+const Kernels *sse42_kernels();
+const Kernels *avx2_kernels();
+
+} // namespace NNUE
+
+#endif
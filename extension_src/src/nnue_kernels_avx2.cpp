@@ -0,0 +1,67 @@
+// AVX2 の実装。SConstruct がこのファイルだけ -mavx2 -mbmi2（MSVC は /arch:AVX2）でビルドする
+#include "nnue_kernels.hpp"
+
+#if defined(SHOGI_DISPATCH_X86)
+#include "nnue_evaluator.hpp"
+#include <immintrin.h>
+
+namespace {
+
+void add_weights(int16_t *accumulator, const int16_t *weights) {
+    for (int i = 0; i < NNUE::L1; i += 16) {
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i *>(accumulator + i));
+        __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights + i));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(accumulator + i), _mm256_add_epi16(a, w));
+    }
+}
+
+void sub_weights(int16_t *accumulator, const int16_t *weights) {
+    for (int i = 0; i < NNUE::L1; i += 16) {
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i *>(accumulator + i));
+        __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights + i));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(accumulator + i), _mm256_sub_epi16(a, w));
+    }
+}
+
+void clipped_relu(const int16_t *input, uint8_t *output, int size) {
+    // packus は128ビットの組ごとに詰めるので、並びを戻してから書く
+    const __m256i limit = _mm256_set1_epi8(127);
+    int i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i lo = _mm256_load_si256(reinterpret_cast<const __m256i *>(input + i));
+        __m256i hi = _mm256_load_si256(reinterpret_cast<const __m256i *>(input + i + 16));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i), _mm256_min_epu8(packed, limit));
+    }
+    for (; i < size; i += 16) {
+        __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i *>(input + i));
+        __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i *>(input + i + 8));
+        __m128i packed = _mm_min_epu8(_mm_packus_epi16(lo, hi), _mm256_castsi256_si128(limit));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), packed);
+    }
+}
+
+int32_t dot_product(const uint8_t *input, const int8_t *weights, int size) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < size; i += 32) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + i));
+        __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i *>(weights + i));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones));
+    }
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0x4E));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0xB1));
+    return _mm_cvtsi128_si32(sum128);
+}
+
+const NNUE::Kernels AVX2_KERNELS = {"avx2", add_weights, sub_weights, clipped_relu, dot_product};
+
+} // namespace
+
+namespace NNUE {
+
+const Kernels *avx2_kernels() { return &AVX2_KERNELS; }
+
+} // namespace NNUE
+#endif
@@ -0,0 +1,59 @@
+// SSE4.2 の実装。SConstruct がこのファイルだけ -msse4.2 でビルドする
+#include "nnue_kernels.hpp"
+
+#if defined(SHOGI_DISPATCH_X86)
+#include "nnue_evaluator.hpp"
+#include <nmmintrin.h>
+
+namespace {
+
+void add_weights(int16_t *accumulator, const int16_t *weights) {
+    for (int i = 0; i < NNUE::L1; i += 8) {
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i *>(accumulator + i));
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(weights + i));
+        _mm_store_si128(reinterpret_cast<__m128i *>(accumulator + i), _mm_add_epi16(a, w));
+    }
+}
+
+void sub_weights(int16_t *accumulator, const int16_t *weights) {
+    for (int i = 0; i < NNUE::L1; i += 8) {
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i *>(accumulator + i));
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(weights + i));
+        _mm_store_si128(reinterpret_cast<__m128i *>(accumulator + i), _mm_sub_epi16(a, w));
+    }
+}
+
+void clipped_relu(const int16_t *input, uint8_t *output, int size) {
+    const __m128i limit = _mm_set1_epi8(127);
+    for (int i = 0; i < size; i += 16) {
+        __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i *>(input + i));
+        __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i *>(input + i + 8));
+        __m128i packed = _mm_min_epu8(_mm_packus_epi16(lo, hi), limit);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), packed);
+    }
+}
+
+int32_t dot_product(const uint8_t *input, const int8_t *weights, int size) {
+    // SSSE3 の maddubs で符号なし x 符号付きの積和を1命令で取る（入力は 127 以下なので飽和しない）
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < size; i += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + i));
+        __m128i w = _mm_load_si128(reinterpret_cast<const __m128i *>(weights + i));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(in, w), ones));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+const NNUE::Kernels SSE42_KERNELS = {"sse4.2", add_weights, sub_weights, clipped_relu, dot_product};
+
+} // namespace
+
+namespace NNUE {
+
+const Kernels *sse42_kernels() { return &SSE42_KERNELS; }
+
+} // namespace NNUE
+#endif
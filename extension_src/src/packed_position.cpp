@@ -0,0 +1,86 @@
+#include "packed_position.hpp"
+#include <cstring>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+bool PackedPositionWriter::open(const String &path) {
+    file = FileAccess::open(path, FileAccess::WRITE);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("PackedPosition: cannot write ", path);
+        return false;
+    }
+    count = 0;
+    return true;
+}
+
+uint64_t PackedPositionWriter::write(const std::vector<PackedPosition> &positions) {
+    if (positions.empty()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+
+    // リトルエンディアンのまま並べる
+    PackedByteArray bytes;
+    bytes.resize(static_cast<int64_t>(positions.size() * sizeof(PackedPosition)));
+    std::memcpy(bytes.ptrw(), positions.data(), positions.size() * sizeof(PackedPosition));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file.is_valid()) {
+        file->store_buffer(bytes);
+        count += positions.size();
+    }
+    return count;
+}
+
+void PackedPositionWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file.is_valid()) {
+        file->close();
+        file.unref();
+    }
+}
+
+bool PackedPositionReader::open(const String &path) {
+    file = FileAccess::open(path, FileAccess::READ);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("PackedPosition: cannot open ", path);
+        return false;
+    }
+
+    uint64_t length = file->get_length();
+    if (length % sizeof(PackedPosition) != 0) {
+        UtilityFunctions::printerr("PackedPosition: unexpected file size: ", path);
+        file.unref();
+        return false;
+    }
+
+    total = length / sizeof(PackedPosition);
+    buffer.clear();
+    cursor = 0;
+    return true;
+}
+
+bool PackedPositionReader::fill() {
+    if (file.is_null()) {
+        return false;
+    }
+
+    PackedByteArray bytes = file->get_buffer(BUFFER_POSITIONS * static_cast<int64_t>(sizeof(PackedPosition)));
+    size_t read = static_cast<size_t>(bytes.size()) / sizeof(PackedPosition);
+    if (read == 0) {
+        file.unref();
+        return false;
+    }
+
+    buffer.resize(read);
+    std::memcpy(buffer.data(), bytes.ptr(), read * sizeof(PackedPosition));
+    cursor = 0;
+    return true;
+}
+
+bool PackedPositionReader::next(PackedPosition &position) {
+    if (cursor >= buffer.size() && !fill()) {
+        return false;
+    }
+    position = buffer[cursor++];
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef PACKED_POSITION_HPP
+#define PACKED_POSITION_HPP
+
+#include "board_state.hpp"
+#include <cstdint>
+#include <godot_cpp/classes/file_access.hpp>
+#include <mutex>
+#include <vector>
+
+using namespace godot;
+
+// 学習データの1局面（40バイト）。ファイルはヘッダなしでこれを並べたもの
+struct PackedPosition {
+    uint8_t sfen[BoardState::PACKED_SFEN_SIZE]; // BoardState::pack_sfen
+    int16_t score;                              // 手番側から見た探索の評価値
+    uint16_t move;                              // 探索の最善手（Shogi::encode_move）
+    uint16_t ply;                               // 開始局面からの手数
+    int8_t result;                              // 手番側から見た終局の結果（1 = 勝ち、0 = 引き分け、-1 = 負け）
+    uint8_t padding;
+};
+
+static_assert(sizeof(PackedPosition) == 40, "training files assume 40-byte records");
+
+// 複数のスレッドからまとめて書き足す
+class PackedPositionWriter {
+  private:
+    Ref<FileAccess> file;
+    std::mutex mutex;
+    uint64_t count = 0;
+
+  public:
+    bool open(const String &path);
+    // 書き足した後の総数を返す（書いている途中の件数はこれで知る）
+    uint64_t write(const std::vector<PackedPosition> &positions);
+    void close();
+    // ロックを取らないので、すべてのスレッドが書き終えてから呼ぶ
+    uint64_t get_count() const { return count; }
+};
+
+// 先頭から少しずつ読み込む（ファイル全体はメモリに載せない）
+class PackedPositionReader {
+  private:
+    static const int BUFFER_POSITIONS = 1 << 14;
+
+    Ref<FileAccess> file;
+    std::vector<PackedPosition> buffer;
+    size_t cursor = 0;
+    uint64_t total = 0;
+
+    bool fill();
+
+  public:
+    bool open(const String &path);
+    // 読み終えたら false を返す
+    bool next(PackedPosition &position);
+    uint64_t get_total() const { return total; }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "position_history.hpp"
+
+PositionHistory::PositionHistory() {
+    entries.reserve(512);
+    clear();
+}
+
+void PositionHistory::clear() {
+    entries.clear();
+    for (int i = 0; i < FILTER_SIZE; ++i) {
+        filter[i] = 0;
+    }
+}
+
+void PositionHistory::push(uint64_t key, bool in_check) {
+    entries.push_back({key, in_check});
+    filter[key & (FILTER_SIZE - 1)]++;
+}
+
+void PositionHistory::pop() {
+    if (entries.empty()) {
+        return;
+    }
+
+    filter[entries.back().key & (FILTER_SIZE - 1)]--;
+    entries.pop_back();
+}
+
+PositionHistory::Repetition PositionHistory::check_repetition() const {
+    int n = static_cast<int>(entries.size());
+    if (n < 5) {
+        return REPETITION_NONE;
+    }
+
+    const Entry &current = entries[n - 1];
+
+    // 同じ索引の局面が他に無ければ繰り返しは起こり得ない
+    if (filter[current.key & (FILTER_SIZE - 1)] <= 1) {
+        return REPETITION_NONE;
+    }
+
+    // 手番側が王手され続けているか / 相手が王手され続けているか
+    bool checked_continuously = current.in_check;
+    bool checking_continuously = true;
+
+    // 同じ手番の局面は2手おきにしか現れない
+    for (int i = n - 2; i >= 1; i -= 2) {
+        checking_continuously = checking_continuously && entries[i].in_check;
+        checked_continuously = checked_continuously && entries[i - 1].in_check;
+
+        if (entries[i - 1].key == current.key) {
+            if (checked_continuously) {
+                return REPETITION_WIN;
+            }
+            if (checking_continuously) {
+                return REPETITION_LOSS;
+            }
+            return REPETITION_DRAW;
+        }
+    }
+
+    return REPETITION_NONE;
+}
@@ -0,0 +1,45 @@
+#ifndef POSITION_HISTORY_HPP
+#define POSITION_HISTORY_HPP
+
+#include <cstdint>
+#include <vector>
+
+// 千日手判定用の局面履歴
+// 対局で指された手と探索中の手順の両方を、手番込みのハッシュ値で積む
+class PositionHistory {
+  public:
+    enum Repetition {
+        REPETITION_NONE,
+        REPETITION_DRAW, // 千日手（引き分け）
+        REPETITION_WIN,  // 相手の連続王手の千日手（手番側の勝ち）
+        REPETITION_LOSS, // 自分の連続王手の千日手（手番側の負け）
+    };
+
+  private:
+    struct Entry {
+        uint64_t key;
+        bool in_check; // この局面の手番側が王手されているか
+    };
+
+    // 同一局面が存在し得るかを調べるための簡易カウンタ（下位ビットで索引）
+    static const int FILTER_SIZE = 1024;
+
+    std::vector<Entry> entries;
+    uint16_t filter[FILTER_SIZE];
+
+  public:
+    PositionHistory();
+
+    void clear();
+    // 探索中の push で確保し直さないよう、あらかじめ領域を取っておく
+    void reserve(int count) { entries.reserve(count); }
+    void push(uint64_t key, bool in_check);
+    void pop();
+    int size() const { return static_cast<int>(entries.size()); }
+    uint64_t top_key() const { return entries.empty() ? 0 : entries.back().key; }
+
+    // 最後に積んだ局面が過去の局面の繰り返しかを判定する（手番側から見た結果）
+    Repetition check_repetition() const;
+};
+
+#endif
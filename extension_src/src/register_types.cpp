@@ -1,4 +1,7 @@
 #include "register_types.hpp"
+#include "data_generator.hpp"
+#include "eval_tuner.hpp"
+#include "match_runner.hpp"
 #include "shogi_engine.hpp"
 #include <gdextension_interface.h>
 #include <godot_cpp/core/defs.hpp>
@@ -12,6 +15,9 @@ void initialize_shogi_engine_module(ModuleInitializationLevel p_level) {
     }
 
     GDREGISTER_CLASS(ShogiEngine);
+    GDREGISTER_CLASS(MatchRunner);
+    GDREGISTER_CLASS(EvalTuner);
+    GDREGISTER_CLASS(DataGenerator);
 }
 
 void uninitialize_shogi_engine_module(ModuleInitializationLevel p_level) {
@@ -0,0 +1,19 @@
+#include "search_stack.hpp"
+
+SearchStack::SearchStack() : frames(MAX_PLY + 1), root_pvs(MAX_ROOT_MOVES * 2 * MAX_PLY) {
+    for (Frame &frame : frames) {
+        frame.moves.reserve(MAX_MOVES);
+    }
+    reset();
+}
+
+void SearchStack::reset() {
+    for (Frame &frame : frames) {
+        frame.moves.clear();
+        frame.current_move = Shogi::Move();
+        frame.static_eval = 0;
+        frame.killers[0] = Shogi::Move();
+        frame.killers[1] = Shogi::Move();
+        frame.pv_length = 0;
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef SEARCH_STACK_HPP
+#define SEARCH_STACK_HPP
+
+#include "shogi_utils.hpp"
+#include <cstdint>
+#include <vector>
+
+// 探索スレッドごとの作業領域
+// 1手（ply）ごとのフレームを最初にまとめて確保し、探索をまたいで使い回す。探索中はヒープを使わない
+class SearchStack {
+  public:
+    static const int MAX_PLY = 128;
+    static const int MAX_MOVES = 1024; // 1局面の疑似合法手の上限（合法手は最大593）
+    static const int MAX_ROOT_MOVES = 600; // ルートの合法手の上限
+
+    struct Frame {
+        std::vector<Shogi::Move> moves; // MAX_MOVES 分を確保済み
+        Shogi::Move current_move;
+        int static_eval;
+        Shogi::Move killers[2]; // βカットを起こした駒を取らない手
+        int pv_length;
+        Shogi::Move pv[MAX_PLY]; // この局面からの読み筋
+    };
+
+  private:
+    std::vector<Frame> frames;
+    // ルートの手ごとの読み筋（MAX_PLY 手ずつ）。読み終えた反復の読み筋を次の反復で消さないよう、深さの偶奇で2面持つ
+    std::vector<Shogi::Move> root_pvs;
+
+  public:
+    SearchStack();
+
+    SearchStack(const SearchStack &) = delete;
+    SearchStack &operator=(const SearchStack &) = delete;
+
+    Frame &at(int ply) { return frames[ply]; }
+    // root_index 番目のルートの手を depth で読んだときの読み筋の置き場所
+    Shogi::Move *root_pv(int root_index, int depth) { return &root_pvs[(root_index * 2 + (depth & 1)) * MAX_PLY]; }
+
+    // 探索の始めにキラー手と読み筋を消す
+    void reset();
+};
+
+#endif
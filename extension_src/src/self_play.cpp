@@ -0,0 +1,101 @@
+#include "self_play.hpp"
+#include "search_stack.hpp"
+#include <cstdlib>
+#include <godot_cpp/classes/time.hpp>
+#include <unordered_map>
+
+bool SelfPlayGame::load_network(const Dictionary &config, std::shared_ptr<const NNUE::Network> &network) {
+    String network_path = config.get("eval_network", String());
+    if (network_path.is_empty()) {
+        return true;
+    }
+
+    std::shared_ptr<NNUE::Network> loaded = std::make_shared<NNUE::Network>();
+    if (!loaded->load(network_path)) {
+        return false;
+    }
+    network = loaded;
+    return true;
+}
+
+int SelfPlayGame::play(BoardState board, int side, std::mt19937_64 *rng, SearchStack &stack,
+                       std::vector<Ply> &plies) const {
+    plies.clear();
+
+    PositionHistory history;
+    std::unordered_map<uint64_t, int> counts;
+    uint64_t key = board.get_key(side);
+    history.push(key, board.is_king_in_check(side));
+    counts[key] = 1;
+
+    // 探索器は手番ごとに1つ作って使い回す
+    AIPlayer players[2] = {AIPlayer(false, history, *engines[0].tt), AIPlayer(true, history, *engines[1].tt)};
+    for (int i = 0; i < 2; ++i) {
+        players[i].set_network(engines[i].network);
+        players[i].set_search_stack(&stack);
+    }
+
+    std::vector<Shogi::Move> moves;
+    for (int ply = 0; ply < max_plies; ++ply) {
+        Ply record;
+        record.board = board;
+        record.side = side;
+
+        if (ply < random_plies && rng != nullptr) {
+            board.generate_legal_moves(side, moves);
+            if (moves.empty()) {
+                return 1 - side;
+            }
+            record.move = moves[(*rng)() % moves.size()];
+            plies.push_back(record);
+        } else {
+            AIPlayer &player = players[side];
+            player.reset(side == Shogi::ENEMY, history);
+            player.set_limits(engines[side].limits);
+            player.set_verbose(false);
+
+            uint64_t start = Time::get_singleton()->get_ticks_usec();
+            const std::vector<AIPlayer::RootMove> &root_moves = player.search_root(board, 1);
+            uint64_t usec = Time::get_singleton()->get_ticks_usec() - start;
+
+            // 指す手がなければ手番側の負け（入玉宣言なら勝ち）
+            if (root_moves.empty()) {
+                return player.is_declaring_win() ? side : 1 - side;
+            }
+
+            const AIPlayer::RootMove &best = root_moves[0];
+            record.searched = true;
+            record.move = best.move;
+            record.score = best.score;
+            record.depth = best.depth;
+            record.nodes = player.get_nodes();
+            record.usec = usec;
+            plies.push_back(record);
+
+            // 大差がついたら指し切らずに勝敗を決める
+            if (eval_limit > 0 && std::abs(best.score) >= eval_limit) {
+                return best.score > 0 ? side : 1 - side;
+            }
+        }
+
+        board.apply_move(record.move, side);
+        side = 1 - side;
+
+        key = board.get_key(side);
+        history.push(key, board.is_king_in_check(side));
+        if (++counts[key] >= REPETITION_COUNT) {
+            // 判定は手番側から見た結果
+            switch (history.check_repetition()) {
+            case PositionHistory::REPETITION_WIN:
+                return side;
+            case PositionHistory::REPETITION_LOSS:
+                return 1 - side;
+            default:
+                return -1;
+            }
+        }
+    }
+
+    // 手数制限で引き分け
+    return -1;
+}
@@ -0,0 +1,52 @@
+#ifndef SELF_PLAY_HPP
+#define SELF_PLAY_HPP
+
+#include "ai_player.hpp"
+#include "nnue_evaluator.hpp"
+#include <godot_cpp/variant/dictionary.hpp>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace godot;
+
+// 自己対局の1局（MatchRunner と DataGenerator で共有する）
+// 手番ごとの探索設定で指し進め、詰み・入玉宣言・千日手・手数制限・評価値の大差で勝敗を決める
+class SelfPlayGame {
+  public:
+    // 手番の側の探索設定
+    struct Engine {
+        SearchLimits limits;
+        std::shared_ptr<const NNUE::Network> network;
+        TranspositionTable *tt = nullptr;
+    };
+
+    // 指した1手
+    struct Ply {
+        BoardState board; // 指す前の局面
+        int side = Shogi::PLAYER;
+        bool searched = false; // false ならランダムに選んだ手
+        Shogi::Move move;
+        int score = 0; // 以下は探索した手のルートの結果（手番側から見た評価値）
+        int depth = 0;
+        uint64_t nodes = 0;
+        uint64_t usec = 0;
+    };
+
+  private:
+    static const int REPETITION_COUNT = 4; // 同一局面4回で千日手
+
+  public:
+    Engine engines[2]; // 手番（Shogi::PLAYER / Shogi::ENEMY）ごと
+    int max_plies = 256;
+    int random_plies = 0; // 序盤をランダムに指す手数（rng が要る）
+    int eval_limit = 0;   // 評価値の絶対値がこれ以上なら勝敗を決める（0 なら決めない）
+
+    // config の eval_network が空でなければ読み込んで network を置き換える
+    static bool load_network(const Dictionary &config, std::shared_ptr<const NNUE::Network> &network);
+
+    // board から side の手番で1局指し、勝った側（引き分けなら -1）を返す。plies は上書きされる
+    int play(BoardState board, int side, std::mt19937_64 *rng, SearchStack &stack, std::vector<Ply> &plies) const;
+};
+
+#endif
@@ -1,5 +1,12 @@
 #include "shogi_engine.hpp"
 #include "ai_player.hpp"
+#include "allocation_counter.hpp"
+#include "benchmark.hpp"
+#include "game_analyzer.hpp"
+#include "nnue_kernels.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <godot_cpp/classes/node.hpp>
 #include <godot_cpp/classes/time.hpp>
 #include <godot_cpp/core/class_db.hpp>
@@ -7,6 +14,51 @@
 
 using namespace godot;
 
+namespace {
+
+// 棋力ごとの探索量と手のばらつき
+struct SkillSettings {
+    uint64_t nodes;
+    int depth;
+    int multi_pv;     // 候補にする手の数
+    int score_margin; // 最善手からこの点差以内の手を候補にする
+};
+
+SkillSettings get_skill_settings(int level) {
+    SkillSettings settings;
+    // 2段階ごとにノード数を倍にする（0: 200ノード、19: 153,600ノード）
+    settings.nodes = static_cast<uint64_t>(200) << (level / 2);
+    if (level % 2 == 1) {
+        settings.nodes = settings.nodes * 3 / 2;
+    }
+    settings.depth = std::min(10, 1 + level / 3);
+    settings.multi_pv = (level < 10) ? 4 : (level < 15 ? 3 : 2);
+    settings.score_margin = (ShogiEngine::MAX_SKILL_LEVEL - level) * 15;
+    return settings;
+}
+
+// 最善手との差が小さい手ほど選ばれやすくする（詰みがあるときは必ず最善手）
+int choose_root_move(const std::vector<AIPlayer::RootMove> &root_moves, int score_margin, std::mt19937 &rng) {
+    int best_score = root_moves[0].score;
+    if (best_score >= 999999) {
+        return 0;
+    }
+
+    std::vector<int> weights;
+    for (const AIPlayer::RootMove &root_move : root_moves) {
+        int loss = best_score - root_move.score;
+        weights.push_back(loss <= score_margin ? score_margin - loss + 1 : 0);
+    }
+    std::discrete_distribution<int> distribution(weights.begin(), weights.end());
+    return distribution(rng);
+}
+
+// 置換表の大きさで探索が変わらないよう、どの環境でも同じ大きさにする
+const int BENCH_HASH_MB = 4;
+const int BENCH_MAX_DEPTH = 64;
+
+} // namespace
+
 void ShogiEngine::_bind_methods() {
     ClassDB::bind_static_method("ShogiEngine",
                                 D_METHOD("is_legal_move", "main_node", "piece_obj", "target_col", "target_row"),
@@ -23,19 +75,179 @@ void ShogiEngine::_bind_methods() {
         &ShogiEngine::is_king_safe_after_move);
     ClassDB::bind_static_method("ShogiEngine", D_METHOD("is_king_in_check", "main_node", "is_enemy"),
                                 &ShogiEngine::is_king_in_check);
-
-    ClassDB::bind_method(D_METHOD("update_state", "main_node"), &ShogiEngine::update_state);
+    ClassDB::bind_static_method(
+        "ShogiEngine", D_METHOD("analyze_game", "moves", "nodes_per_move", "blunder_threshold", "threads"),
+        &ShogiEngine::analyze_game, DEFVAL(20000), DEFVAL(0.2), DEFVAL(0));
+    ClassDB::bind_static_method("ShogiEngine", D_METHOD("perft", "depth"), &ShogiEngine::perft);
+    ClassDB::bind_static_method("ShogiEngine", D_METHOD("dump_trace", "path"), &ShogiEngine::dump_trace);
+    ClassDB::bind_static_method("ShogiEngine", D_METHOD("clear_trace"), &ShogiEngine::clear_trace);
+    ClassDB::bind_static_method("ShogiEngine", D_METHOD("bench", "nodes_per_position"), &ShogiEngine::bench,
+                                DEFVAL(200000));
+    ClassDB::bind_static_method("ShogiEngine", D_METHOD("microbench", "samples", "main_node"),
+                                &ShogiEngine::microbench, DEFVAL(200), DEFVAL(Variant()));
+
+    ClassDB::bind_method(D_METHOD("update_state", "main_node", "is_enemy_turn"), &ShogiEngine::update_state);
+    ClassDB::bind_method(D_METHOD("new_game"), &ShogiEngine::new_game);
+    ClassDB::bind_method(D_METHOD("push_move", "move"), &ShogiEngine::push_move);
+    ClassDB::bind_method(D_METHOD("pop_move"), &ShogiEngine::pop_move);
+    ClassDB::bind_method(D_METHOD("get_move_count"), &ShogiEngine::get_move_count);
     ClassDB::bind_method(D_METHOD("search_best_move"), &ShogiEngine::search_best_move);
+    ClassDB::bind_method(D_METHOD("begin_search"), &ShogiEngine::begin_search);
+    ClassDB::bind_method(D_METHOD("continue_search", "slice_usec"), &ShogiEngine::continue_search, DEFVAL(8000));
+    ClassDB::bind_method(D_METHOD("get_search_result"), &ShogiEngine::get_search_result);
+    ClassDB::bind_method(D_METHOD("search_multi_pv", "multi_pv"), &ShogiEngine::search_multi_pv);
+    ClassDB::bind_method(D_METHOD("search_best_move_deterministic", "nodes", "threads"),
+                         &ShogiEngine::search_best_move_deterministic, DEFVAL(0));
 
     ClassDB::bind_method(D_METHOD("set_is_enemy_side", "is_enemy"), &ShogiEngine::set_is_enemy_side);
     ClassDB::bind_method(D_METHOD("get_is_enemy_side"), &ShogiEngine::get_is_enemy_side);
     ADD_PROPERTY(PropertyInfo(Variant::BOOL, "is_enemy_side"), "set_is_enemy_side", "get_is_enemy_side");
+
+    ClassDB::bind_method(D_METHOD("set_hash_size_mb", "size_mb"), &ShogiEngine::set_hash_size_mb);
+    ClassDB::bind_method(D_METHOD("get_hash_size_mb"), &ShogiEngine::get_hash_size_mb);
+    ClassDB::bind_method(D_METHOD("clear_hash"), &ShogiEngine::clear_hash);
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "hash_size_mb"), "set_hash_size_mb", "get_hash_size_mb");
+
+    ClassDB::bind_method(D_METHOD("set_skill_level", "level"), &ShogiEngine::set_skill_level);
+    ClassDB::bind_method(D_METHOD("get_skill_level"), &ShogiEngine::get_skill_level);
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "skill_level", PROPERTY_HINT_RANGE, "0,20"), "set_skill_level",
+                 "get_skill_level");
+
+    ClassDB::bind_method(D_METHOD("load_eval_network", "path"), &ShogiEngine::load_eval_network);
+    ClassDB::bind_method(D_METHOD("load_experience", "path"), &ShogiEngine::load_experience);
+    ClassDB::bind_method(D_METHOD("save_experience", "path"), &ShogiEngine::save_experience);
+    ClassDB::bind_method(D_METHOD("get_experience_size"), &ShogiEngine::get_experience_size);
+    ClassDB::bind_method(D_METHOD("set_experience_recording", "enabled"), &ShogiEngine::set_experience_recording);
+    ClassDB::bind_method(D_METHOD("get_experience_recording"), &ShogiEngine::get_experience_recording);
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "experience_recording"), "set_experience_recording",
+                 "get_experience_recording");
+    ClassDB::bind_method(D_METHOD("set_eval_backend", "backend"), &ShogiEngine::set_eval_backend);
+    ClassDB::bind_method(D_METHOD("get_eval_backend"), &ShogiEngine::get_eval_backend);
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "eval_backend", PROPERTY_HINT_ENUM, "Material,NNUE"), "set_eval_backend",
+                 "get_eval_backend");
+
+    BIND_ENUM_CONSTANT(EVAL_MATERIAL);
+    BIND_ENUM_CONSTANT(EVAL_NNUE);
+}
+
+ShogiEngine::ShogiEngine() : stack(new SearchStack()) {
+    new_game();
+    searcher.reset(new AIPlayer(is_enemy_side, game_history, tt));
+    searcher->set_search_stack(stack.get());
+}
+
+ShogiEngine::~ShogiEngine() {
+    if (save_thread.joinable()) {
+        save_thread.join();
+    }
 }
 
 void ShogiEngine::set_is_enemy_side(bool is_enemy) { is_enemy_side = is_enemy; }
 
 bool ShogiEngine::get_is_enemy_side() const { return is_enemy_side; }
 
+void ShogiEngine::set_hash_size_mb(int size_mb) { tt.resize(size_mb); }
+
+int ShogiEngine::get_hash_size_mb() const { return tt.get_size_mb(); }
+
+void ShogiEngine::clear_hash() { tt.clear(); }
+
+void ShogiEngine::set_skill_level(int level) { skill_level = std::max(0, std::min(level, MAX_SKILL_LEVEL)); }
+
+int ShogiEngine::get_skill_level() const { return skill_level; }
+
+bool ShogiEngine::load_eval_network(const String &path) {
+    std::shared_ptr<NNUE::Network> loaded = std::make_shared<NNUE::Network>();
+    if (!loaded->load(path)) {
+        return false;
+    }
+
+    network = loaded;
+    return true;
+}
+
+bool ShogiEngine::load_experience(const String &path) {
+    std::shared_ptr<ExperienceStore> loaded = std::make_shared<ExperienceStore>();
+    if (!loaded->load(path)) {
+        return false;
+    }
+
+    experience = loaded;
+    return true;
+}
+
+bool ShogiEngine::save_experience(const String &path) {
+    if (save_thread.joinable()) {
+        save_thread.join();
+    }
+
+    // 混ぜた結果はこの後の探索でもそのまま使う
+    merge_recorded();
+    std::shared_ptr<const ExperienceStore> merged = experience;
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    return merged->save(path);
+#else
+    save_thread = std::thread([merged, path]() {
+        SHOGI_TRACE_THREAD_NAME("experience save");
+        SHOGI_TRACE_SCOPE("save experience", merged->size());
+        merged->save(path);
+    });
+    return true;
+#endif
+}
+
+int ShogiEngine::get_experience_size() const { return experience ? experience->size() : 0; }
+
+void ShogiEngine::set_experience_recording(bool enabled) { experience_recording = enabled; }
+
+bool ShogiEngine::get_experience_recording() const { return experience_recording; }
+
+void ShogiEngine::record_experience() {
+    if (!experience_recording) {
+        return;
+    }
+
+    std::vector<ExperienceStore::Entry> deep_entries;
+    tt.collect(ExperienceStore::MIN_DEPTH, deep_entries);
+    for (const ExperienceStore::Entry &entry : deep_entries) {
+        auto it = recorded.find(entry.key);
+        if (it == recorded.end() || entry.depth >= it->second.depth) {
+            recorded[entry.key] = entry;
+        }
+    }
+
+    // 書き出しまで溜め続けないよう、上限に達したら混ぜて浅いものを捨てる
+    if (recorded.size() >= static_cast<size_t>(ExperienceStore::MAX_ENTRIES)) {
+        merge_recorded();
+    }
+}
+
+void ShogiEngine::merge_recorded() {
+    std::vector<ExperienceStore::Entry> entries;
+    if (experience) {
+        entries = experience->get_entries();
+    }
+    for (const auto &pair : recorded) {
+        entries.push_back(pair.second);
+    }
+    recorded.clear();
+
+    experience = std::make_shared<ExperienceStore>(std::move(entries));
+}
+
+void ShogiEngine::set_eval_backend(int backend) { eval_backend = backend; }
+
+int ShogiEngine::get_eval_backend() const { return eval_backend; }
+
+std::shared_ptr<const NNUE::Network> ShogiEngine::active_network() const {
+    // 重みが読み込まれていなければ駒得評価のまま
+    if (eval_backend == EVAL_NNUE) {
+        return network;
+    }
+    return nullptr;
+}
+
 bool ShogiEngine::is_legal_move(Node2D *main_node, Object *piece_obj, int target_col, int target_row) {
     if (!piece_obj) {
         return false;
@@ -144,12 +356,232 @@ bool ShogiEngine::is_king_in_check(Node2D *main_node, bool is_enemy) {
     return board.is_king_in_check(side);
 }
 
-void ShogiEngine::update_state(Node2D *main_node) {
+Dictionary ShogiEngine::analyze_game(const Array &moves, int nodes_per_move, double blunder_threshold, int threads) {
+    GameAnalyzer analyzer;
+    if (!analyzer.load_moves(moves)) {
+        return Dictionary();
+    }
+
+    analyzer.run(static_cast<uint64_t>(std::max(1, nodes_per_move)), threads);
+    return analyzer.get_result(blunder_threshold);
+}
+
+Dictionary ShogiEngine::perft(int depth) {
+    BoardState board;
+    board.init_startpos();
+
+    uint64_t start = Time::get_singleton()->get_ticks_usec();
+    uint64_t nodes = Benchmark::perft(board, Shogi::PLAYER, depth);
+    uint64_t usec = Time::get_singleton()->get_ticks_usec() - start;
+
+    Dictionary result;
+    result["nodes"] = static_cast<int64_t>(nodes);
+    result["usec"] = static_cast<int64_t>(usec);
+    result["nps"] = usec > 0 ? static_cast<int64_t>(nodes * 1000000 / usec) : static_cast<int64_t>(0);
+    return result;
+}
+
+Dictionary ShogiEngine::bench(int nodes_per_position) {
+    TranspositionTable bench_tt(BENCH_HASH_MB);
+    SearchStack bench_stack;
+    PositionHistory bench_history;
+    AIPlayer ai_player(false, bench_history, bench_tt);
+    ai_player.set_search_stack(&bench_stack);
+    uint64_t nodes = 0;
+    uint64_t usec = 0;
+    uint64_t allocations = 0;
+
+    for (const char *sfen : Benchmark::POSITIONS) {
+        BoardState board;
+        int side_to_move = Shogi::PLAYER;
+        if (!board.set_sfen(sfen, side_to_move)) {
+            UtilityFunctions::printerr("Invalid bench position: ", sfen);
+            continue;
+        }
+
+        // 駒得評価・1スレッド・ノード数だけで打ち切る
+        ai_player.reset(side_to_move == Shogi::ENEMY, bench_history);
+        SearchLimits limits;
+        limits.time_usec = 0;
+        limits.nodes = static_cast<uint64_t>(std::max(1, nodes_per_position));
+        limits.depth = BENCH_MAX_DEPTH;
+        ai_player.set_limits(limits);
+        ai_player.set_verbose(false);
+
+        bench_tt.clear();
+        uint64_t allocations_before = AllocationCounter::get();
+        uint64_t start = Time::get_singleton()->get_ticks_usec();
+        ai_player.search_root(board, 1);
+        usec += Time::get_singleton()->get_ticks_usec() - start;
+        allocations += AllocationCounter::get() - allocations_before;
+        nodes += ai_player.get_nodes();
+    }
+
+    Dictionary result;
+    result["nodes"] = static_cast<int64_t>(nodes);
+    result["usec"] = static_cast<int64_t>(usec);
+    result["nps"] = usec > 0 ? static_cast<int64_t>(nodes * 1000000 / usec) : static_cast<int64_t>(0);
+    // search_root 全体でのヒープ確保の回数（count_allocations=yes でビルドしたときだけ数える。それ以外は -1）
+    result["allocations"] = AllocationCounter::is_enabled() ? static_cast<int64_t>(allocations) : static_cast<int64_t>(-1);
+    if (AllocationCounter::is_enabled() && allocations > 0) {
+        UtilityFunctions::printerr("bench: ", static_cast<int64_t>(allocations), " heap allocations during search");
+    }
+    // NNUE の演算に使う命令セット（起動時に CPU を見て選んだもの）
+    result["simd"] = String(NNUE::select_kernels().name);
+    return result;
+}
+
+Dictionary ShogiEngine::microbench(int samples, Node2D *main_node) {
+    return Benchmark::microbench(std::max(1, samples), main_node);
+}
+
+bool ShogiEngine::dump_trace(const String &path) { return Trace::dump(path); }
+
+void ShogiEngine::clear_trace() { Trace::clear(); }
+
+void ShogiEngine::update_state(Node2D *main_node, bool is_enemy_turn) {
     current_state = BoardState();
     current_state.init_from_main(main_node);
+    side_to_move = is_enemy_turn ? Shogi::ENEMY : Shogi::PLAYER;
+
+    // pop_move で戻せるのはこの局面から積んだ手だけにする
+    move_stack.clear();
+    game_history.clear();
+    game_history.push(current_state.get_key(side_to_move), current_state.is_king_in_check(side_to_move));
 }
 
+void ShogiEngine::new_game() {
+    current_state.init_startpos();
+    side_to_move = Shogi::PLAYER;
+    move_stack.clear();
+
+    game_history.clear();
+    game_history.push(current_state.get_key(side_to_move), current_state.is_king_in_check(side_to_move));
+}
+
+bool ShogiEngine::push_move(const Dictionary &move) {
+    PlayedMove played;
+    if (!GameAnalyzer::parse_move(current_state, side_to_move, move, played.move)) {
+        UtilityFunctions::printerr("push_move: illegal move at ply ", static_cast<int64_t>(move_stack.size() + 1));
+        return false;
+    }
+
+    current_state.apply_move(played.move, side_to_move, played.undo);
+    move_stack.push_back(played);
+    side_to_move = (side_to_move == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+
+    game_history.push(current_state.get_key(side_to_move), current_state.is_king_in_check(side_to_move));
+    return true;
+}
+
+bool ShogiEngine::pop_move() {
+    if (move_stack.empty()) {
+        return false;
+    }
+
+    const PlayedMove &played = move_stack.back();
+    side_to_move = (side_to_move == Shogi::PLAYER) ? Shogi::ENEMY : Shogi::PLAYER;
+    current_state.undo_move(played.move, side_to_move, played.undo);
+    move_stack.pop_back();
+
+    game_history.pop();
+    return true;
+}
+
+int ShogiEngine::get_move_count() const { return static_cast<int>(move_stack.size()); }
+
 Dictionary ShogiEngine::search_best_move() {
-    AIPlayer ai_player(is_enemy_side);
-    return ai_player.search_best_move(current_state);
+    begin_search();
+    continue_search(0);
+    return get_search_result();
+}
+
+void ShogiEngine::begin_search() {
+    SHOGI_TRACE_SCOPE("begin_search", move_stack.size());
+    searcher->reset(is_enemy_side, game_history);
+    searcher->set_network(active_network());
+    if (skill_level == MAX_SKILL_LEVEL) {
+        // 棋力を落としているときは過去の結果で強くならないようにする
+        searcher->set_experience(experience);
+    }
+
+    int multi_pv = 1;
+    if (skill_level < MAX_SKILL_LEVEL) {
+        // 時間ではなくノード数で打ち切るので、端末の速さによらず同じ強さになる
+        SkillSettings settings = get_skill_settings(skill_level);
+        SearchLimits limits;
+        limits.time_usec = 0;
+        limits.nodes = settings.nodes;
+        limits.depth = settings.depth;
+        searcher->set_limits(limits);
+        searcher->set_verbose(false);
+        multi_pv = settings.multi_pv;
+    }
+
+    searcher->begin_root(current_state, multi_pv);
+    searching = true;
+}
+
+bool ShogiEngine::continue_search(int slice_usec) {
+    if (!searching) {
+        return true;
+    }
+    SHOGI_TRACE_SCOPE("continue_search", slice_usec);
+    return searcher->step_root(static_cast<uint64_t>(std::max(0, slice_usec)));
+}
+
+Dictionary ShogiEngine::get_search_result() {
+    Dictionary result;
+    if (!searching) {
+        UtilityFunctions::printerr("get_search_result called without begin_search");
+        return result;
+    }
+
+    // 読み終える前に呼ばれたら、読み終えた深さまでの結果を返す
+    const std::vector<AIPlayer::RootMove> &root_moves = searcher->finish_root();
+    bool declare_win = searcher->is_declaring_win();
+    searching = false;
+    record_experience();
+
+    if (root_moves.empty()) {
+        // 入玉宣言か投了
+        if (declare_win) {
+            result["declare_win"] = true;
+            result["win_rate"] = 1.0;
+        } else {
+            result["win_rate"] = 0.0;
+        }
+        return result;
+    }
+
+    int chosen = 0;
+    if (skill_level < MAX_SKILL_LEVEL) {
+        chosen = choose_root_move(root_moves, get_skill_settings(skill_level).score_margin, rng);
+    }
+
+    const AIPlayer::RootMove &root_move = root_moves[chosen];
+    result = AIPlayer::move_to_dictionary(root_move.move);
+    result["win_rate"] = static_cast<float>(AIPlayer::calculate_win_probability(root_move.score));
+    return result;
+}
+
+Dictionary ShogiEngine::search_best_move_deterministic(int nodes, int threads) {
+    searching = false;
+    searcher->reset(is_enemy_side, game_history);
+    searcher->set_network(active_network());
+
+    // 時間では打ち切らないので、同じ局面・同じノード数なら結果は常に同じ
+    SearchLimits limits;
+    limits.nodes = static_cast<uint64_t>(std::max(1, nodes));
+    searcher->set_limits(limits);
+    searcher->set_root_split_threads(threads > 0 ? threads : ThreadPool::default_thread_count());
+    return searcher->search_best_move(current_state);
+}
+
+Array ShogiEngine::search_multi_pv(int multi_pv) {
+    searching = false;
+    searcher->reset(is_enemy_side, game_history);
+    searcher->set_network(active_network());
+    searcher->set_experience(experience);
+    return searcher->search_multi_pv(current_state, multi_pv);
 }
@@ -2,12 +2,25 @@
 #define SHOGI_ENGINE_HPP
 
 #include "board_state.hpp"
+#include "experience_store.hpp"
+#include "nnue_evaluator.hpp"
+#include "position_history.hpp"
+#include "search_stack.hpp"
+#include "transposition_table.hpp"
 #include <godot_cpp/classes/node2d.hpp>
 #include <godot_cpp/classes/ref_counted.hpp>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 using namespace godot;
 
+namespace godot {
+class AIPlayer;
+}
+
 struct MoveData {
     Object *piece;
     int from_col;
@@ -26,12 +39,52 @@ class ShogiEngine : public RefCounted {
     BoardState current_state;
     bool is_enemy_side = true;
 
+    // push_move で指した手（pop_move で盤面を差分で戻す）
+    struct PlayedMove {
+        Shogi::Move move;
+        BoardState::UndoInfo undo;
+    };
+    std::vector<PlayedMove> move_stack;
+    int side_to_move = Shogi::PLAYER;
+
+    PositionHistory game_history; // 対局で現れた局面
+
+    TranspositionTable tt; // 探索をまたいで使い回す
+
+    std::shared_ptr<const NNUE::Network> network;
+    int eval_backend = EVAL_MATERIAL;
+
+    int skill_level = MAX_SKILL_LEVEL;
+    std::mt19937 rng{std::random_device{}()}; // 低い棋力での手の選択用
+
+    // 探索器と作業領域は最初に作り、探索をまたいで使い回す（手ごとにヒープを確保しない）
+    std::unique_ptr<AIPlayer> searcher;
+    std::unique_ptr<SearchStack> stack;
+    bool searching = false; // begin_search で始めた探索の途中
+
+    // 過去の対局の探索結果と、この起動中に読んだ深い結果（save_experience で混ぜて書き出す）
+    std::shared_ptr<const ExperienceStore> experience;
+    std::unordered_map<uint64_t, ExperienceStore::Entry> recorded;
+    std::thread save_thread;
+    bool experience_recording = false; // 書き出すエンジンだけが探索のたびに置換表から集める
+
+    void record_experience();
+    // recorded を experience に混ぜて空にする
+    void merge_recorded();
+
+    std::shared_ptr<const NNUE::Network> active_network() const;
+
   protected:
     static void _bind_methods();
 
   public:
-    ShogiEngine() {}
-    ~ShogiEngine() {}
+    enum EvalBackend { EVAL_MATERIAL = 0, EVAL_NNUE = 1 };
+
+    // 最大の棋力は従来どおり時間で打ち切る。それより下はノード数と深さで決める
+    static const int MAX_SKILL_LEVEL = 20;
+
+    ShogiEngine();
+    ~ShogiEngine();
 
     static bool is_legal_move(Node2D *main_node, Object *piece_obj, int target_col, int target_row);
     static bool is_legal_drop(Node2D *main_node, Object *piece_obj, int target_col, int target_row);
@@ -39,12 +92,58 @@ class ShogiEngine : public RefCounted {
     static TypedArray<Vector2i> get_legal_drops(Node2D *main_node, Object *piece_obj);
     static bool is_king_safe_after_move(Node2D *main_node, Object *piece_obj, int target_col, int target_row);
     static bool is_king_in_check(Node2D *main_node, bool is_enemy);
+    static Dictionary analyze_game(const Array &moves, int nodes_per_move, double blunder_threshold, int threads);
+    // 開始局面からの perft（局面数と計測時間）
+    static Dictionary perft(int depth);
+    // 決まった局面を決まったノード数だけ1スレッドで読む（ブラウザとデスクトップで比べられる NPS）
+    static Dictionary bench(int nodes_per_position);
+    // 基本操作ごとの ns/op（中央値と分位点）。main_node を渡すとシーンから読む操作も測る
+    static Dictionary microbench(int samples, Node2D *main_node);
+    // 探索スレッドのトレースを Chrome の trace event 形式で書き出す（trace=yes でビルドしたときだけ）
+    static bool dump_trace(const String &path);
+    static void clear_trace();
 
-    void update_state(Node2D *main_node);
+    // シーンの局面から対局をやり直す（それまでの指し手と局面の履歴は捨てる）
+    void update_state(Node2D *main_node, bool is_enemy_turn);
+    // 平手の開始局面から指し手を積む。置換表は待ったをしても消さない
+    void new_game();
+    bool push_move(const Dictionary &move);
+    bool pop_move();
+    int get_move_count() const;
     Dictionary search_best_move();
+    // search_best_move を区切って進める（スレッドが使えないブラウザ向け）。
+    // continue_search は slice_usec ほど読んで戻り、読み終えたら true を返す。
+    // 局面と履歴は begin_search で写すので、別スレッドで読むときも begin_search はメインスレッドで呼ぶ。
+    // 探索器は search_multi_pv などと共有するので、それらを呼ぶと途中の探索は打ち切られる
+    void begin_search();
+    bool continue_search(int slice_usec);
+    Dictionary get_search_result();
+    Array search_multi_pv(int multi_pv);
+    // ルートの手をスレッドに分けて読む決定的な探索（threads が 0 ならハードウェアのスレッド数）
+    Dictionary search_best_move_deterministic(int nodes, int threads);
 
     void set_is_enemy_side(bool is_enemy);
     bool get_is_enemy_side() const;
+
+    void set_hash_size_mb(int size_mb);
+    int get_hash_size_mb() const;
+    void clear_hash();
+
+    void set_skill_level(int level);
+    int get_skill_level() const;
+
+    bool load_eval_network(const String &path);
+
+    // 過去の対局の探索結果を読み込む / この起動中の結果を混ぜて書き出す（書き出しは別スレッド）
+    bool load_experience(const String &path);
+    bool save_experience(const String &path);
+    int get_experience_size() const;
+    void set_experience_recording(bool enabled);
+    bool get_experience_recording() const;
+    void set_eval_backend(int backend);
+    int get_eval_backend() const;
 };
 
+VARIANT_ENUM_CAST(ShogiEngine::EvalBackend);
+
 #endif
@@ -1,6 +1,8 @@
 #ifndef SHOGI_UTILS_HPP
 #define SHOGI_UTILS_HPP
 
+#include <cstdint>
+
 namespace Shogi {
 
 enum PieceType { KING = 0, ROOK = 1, BISHOP = 2, GOLD = 3, SILVER = 4, KNIGHT = 5, LANCE = 6, PAWN = 7, EMPTY = 255 };
@@ -34,6 +36,14 @@ struct Move {
           piece_type((uint8_t)pt), is_promotion(promo), is_drop(drop), is_capture(capture) {}
 };
 
+// 指し手を16ビットに詰める（移動先7ビット、移動元7ビット、成り1ビット）
+// 駒打ちは移動元を BOARD_SIZE + 駒種 で表す。0 は「手なし」
+inline uint16_t encode_move(const Move &move) {
+    int to = move.to_col * BOARD_ROWS + move.to_row;
+    int from = move.is_drop ? BOARD_SIZE + move.piece_type : move.from_col * BOARD_ROWS + move.from_row;
+    return (uint16_t)(to | (from << 7) | (move.is_promotion ? (1 << 14) : 0));
+}
+
 } // namespace Shogi
 
 #endif
@@ -0,0 +1,147 @@
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+
+#ifdef __EMSCRIPTEN__
+#include <godot_cpp/classes/os.hpp>
+
+using namespace godot;
+#endif
+
+int ThreadPool::default_thread_count() {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    return 1;
+#else
+#ifdef __EMSCRIPTEN__
+    // スレッド版のビルドでも、実行しているエクスポートがスレッドなしなら1スレッドで読む
+    if (!OS::get_singleton()->has_feature("threads")) {
+        return 1;
+    }
+#endif
+    return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+#endif
+}
+
+ThreadPool::ThreadPool(int thread_count) {
+    if (thread_count <= 0) {
+        thread_count = default_thread_count();
+    }
+#ifdef __EMSCRIPTEN__
+    thread_count = std::min(thread_count, default_thread_count());
+#endif
+
+    for (int i = 0; i < thread_count; ++i) {
+        queues.emplace_back(new Queue());
+    }
+    for (int i = 1; i < thread_count; ++i) {
+        threads.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+bool ThreadPool::pop_task(int worker, int &task) {
+    // 自分のキューの末尾から
+    {
+        Queue &own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // 他のワーカーのキューの先頭から盗む
+    int count = get_thread_count();
+    for (int offset = 1; offset < count; ++offset) {
+        Queue &victim = *queues[(worker + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::work(int worker) {
+    int task;
+    while (pop_task(worker, task)) {
+        (*job)(task, worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) {
+            done_cv.notify_all();
+        }
+    }
+}
+
+void ThreadPool::worker_loop(int worker) {
+    SHOGI_TRACE_THREAD_NAME("pool worker");
+    uint64_t seen_generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_cv.wait(lock, [&] { return stopping || generation != seen_generation; });
+            if (stopping) {
+                return;
+            }
+            seen_generation = generation;
+            ++active_workers;
+        }
+
+        work(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--active_workers == 0) {
+            done_cv.notify_all();
+        }
+    }
+}
+
+void ThreadPool::run(int task_count, const Job &p_job) {
+    if (task_count <= 0) {
+        return;
+    }
+
+    int count = get_thread_count();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // job を先に置く（キューのロック越しにワーカーから見える）
+        job = &p_job;
+        pending = task_count;
+
+        // 番号順に各ワーカーへ均等に配る
+        for (int task = 0; task < task_count; ++task) {
+            Queue &queue = *queues[task % count];
+            std::lock_guard<std::mutex> queue_lock(queue.mutex);
+            queue.tasks.push_front(task);
+        }
+
+        ++generation;
+    }
+    work_cv.notify_all();
+
+    work(0);
+
+    // 全タスクの完了と、ワーカーが job を参照し終えるのを待つ
+    SHOGI_TRACE_SCOPE("pool wait", task_count);
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [&] { return pending == 0 && active_workers == 0; });
+    job = nullptr;
+}
@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ワークスティーリング方式のスレッドプール
+// 各ワーカーは自分のキューの末尾から取り、空になったら他のワーカーのキューの先頭から盗む。
+// ワーカー 0 は run を呼んだスレッド自身
+class ThreadPool {
+  public:
+    // task は 0 から task_count - 1 の番号、worker は実行したワーカーの番号
+    using Job = std::function<void(int task, int worker)>;
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    const Job *job = nullptr;
+    uint64_t generation = 0;
+    int pending = 0;
+    int active_workers = 0;
+    bool stopping = false;
+
+    bool pop_task(int worker, int &task);
+    void work(int worker);
+    void worker_loop(int worker);
+
+  public:
+    // thread_count が 0 以下ならハードウェアのスレッド数
+    explicit ThreadPool(int thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int get_thread_count() const { return static_cast<int>(queues.size()); }
+
+    // すべてのタスクが終わるまで戻らない
+    void run(int task_count, const Job &p_job);
+
+    static int default_thread_count();
+};
+
+#endif
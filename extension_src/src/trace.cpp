@@ -0,0 +1,173 @@
+#include "trace.hpp"
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#ifdef SHOGI_TRACE
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+// 1スレッドあたりのイベント数（あふれたら古いものから上書きする）
+const uint64_t BUFFER_CAPACITY = 1 << 14;
+
+struct Event {
+    const char *name;
+    int64_t arg;
+    uint64_t ts;  // マイクロ秒
+    uint64_t dur; // 区間の長さ（瞬間のイベントは 0）
+    char phase;   // 'X' = 区間、'i' = 瞬間
+};
+
+struct Buffer {
+    std::vector<Event> events;
+    std::atomic<uint64_t> count{0}; // これまでに書いた数
+    const char *thread_name = nullptr;
+    bool in_use = false;
+
+    Buffer() : events(BUFFER_CAPACITY) {}
+
+    void push(const Event &event) {
+        uint64_t index = count.load(std::memory_order_relaxed);
+        events[index % BUFFER_CAPACITY] = event;
+        count.store(index + 1, std::memory_order_release);
+    }
+};
+
+// バッファは登録したら解放しない。終わったスレッドのバッファは次のスレッドが引き継ぐ
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<Buffer>> buffers;
+
+const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+uint64_t now_usec() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - trace_epoch)
+        .count();
+}
+
+struct ThreadBuffer {
+    Buffer *buffer = nullptr;
+
+    Buffer &get() {
+        if (buffer == nullptr) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            for (const std::unique_ptr<Buffer> &candidate : buffers) {
+                if (!candidate->in_use) {
+                    buffer = candidate.get();
+                    break;
+                }
+            }
+            if (buffer == nullptr) {
+                buffers.emplace_back(new Buffer());
+                buffer = buffers.back().get();
+            }
+            buffer->in_use = true;
+            buffer->thread_name = nullptr;
+        }
+        return *buffer;
+    }
+
+    ~ThreadBuffer() {
+        if (buffer != nullptr) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            buffer->in_use = false;
+        }
+    }
+};
+
+thread_local ThreadBuffer thread_buffer;
+
+void append_event(std::string &json, int tid, const Event &event) {
+    char line[256];
+    if (event.phase == 'X') {
+        std::snprintf(line, sizeof(line),
+                      ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%" PRIu64 ",\"dur\":%" PRIu64
+                      ",\"args\":{\"arg\":%" PRId64 "}}",
+                      event.name, tid, event.ts, event.dur, event.arg);
+    } else {
+        std::snprintf(line, sizeof(line),
+                      ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%" PRIu64
+                      ",\"args\":{\"arg\":%" PRId64 "}}",
+                      event.name, tid, event.ts, event.arg);
+    }
+    json += line;
+}
+
+} // namespace
+#endif
+
+namespace Trace {
+
+bool is_enabled() {
+#ifdef SHOGI_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef SHOGI_TRACE
+void instant(const char *name, int64_t arg) { thread_buffer.get().push(Event{name, arg, now_usec(), 0, 'i'}); }
+
+void set_thread_name(const char *name) { thread_buffer.get().thread_name = name; }
+
+Scope::Scope(const char *p_name, int64_t p_arg) : name(p_name), arg(p_arg), start(now_usec()) {}
+
+Scope::~Scope() { thread_buffer.get().push(Event{name, arg, start, now_usec() - start, 'X'}); }
+#endif
+
+bool dump(const String &path) {
+#ifdef SHOGI_TRACE
+    std::string json = "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                       "\"args\":{\"name\":\"shogi_engine\"}}";
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (size_t tid = 0; tid < buffers.size(); ++tid) {
+            const Buffer &buffer = *buffers[tid];
+            char line[160];
+            std::snprintf(line, sizeof(line),
+                          ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s "
+                          "%d\"}}",
+                          static_cast<int>(tid), buffer.thread_name ? buffer.thread_name : "thread",
+                          static_cast<int>(tid));
+            json += line;
+
+            uint64_t count = buffer.count.load(std::memory_order_acquire);
+            uint64_t first = count > BUFFER_CAPACITY ? count - BUFFER_CAPACITY : 0;
+            for (uint64_t i = first; i < count; ++i) {
+                append_event(json, static_cast<int>(tid), buffer.events[i % BUFFER_CAPACITY]);
+            }
+        }
+    }
+    json += "\n]}\n";
+
+    Ref<FileAccess> file = FileAccess::open(path, FileAccess::WRITE);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("Trace: cannot write ", path);
+        return false;
+    }
+    file->store_string(String::utf8(json.c_str()));
+    return true;
+#else
+    (void)path;
+    UtilityFunctions::printerr("Trace: build with trace=yes to record events");
+    return false;
+#endif
+}
+
+void clear() {
+#ifdef SHOGI_TRACE
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (const std::unique_ptr<Buffer> &buffer : buffers) {
+        buffer->count.store(0, std::memory_order_release);
+    }
+#endif
+}
+
+} // namespace Trace
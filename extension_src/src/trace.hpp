@@ -0,0 +1,54 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+#include <godot_cpp/variant/string.hpp>
+
+using namespace godot;
+
+// 探索スレッドの時系列トレース（SHOGI_TRACE を定義してビルドしたときだけ記録する）
+// スレッドごとのリングバッファにイベントを積み、Chrome の trace event 形式の JSON に書き出す。
+// chrome://tracing や Perfetto で開ける。名前はポインタのまま残すので文字列リテラルだけを渡す
+namespace Trace {
+
+bool is_enabled();
+
+// 探索していないときに呼ぶ（書き込み中のバッファは読まない前提）
+bool dump(const String &path);
+void clear();
+
+#ifdef SHOGI_TRACE
+void instant(const char *name, int64_t arg);
+void set_thread_name(const char *name);
+
+// 生成から破棄までを1つの区間として記録する
+class Scope {
+  private:
+    const char *name;
+    int64_t arg;
+    uint64_t start;
+
+  public:
+    Scope(const char *p_name, int64_t p_arg);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+};
+#endif
+
+} // namespace Trace
+
+#ifdef SHOGI_TRACE
+#define SHOGI_TRACE_CONCAT_INNER(a, b) a##b
+#define SHOGI_TRACE_CONCAT(a, b) SHOGI_TRACE_CONCAT_INNER(a, b)
+#define SHOGI_TRACE_SCOPE(name, arg) Trace::Scope SHOGI_TRACE_CONCAT(trace_scope_, __LINE__)(name, arg)
+#define SHOGI_TRACE_INSTANT(name, arg) Trace::instant(name, arg)
+#define SHOGI_TRACE_THREAD_NAME(name) Trace::set_thread_name(name)
+#else
+#define SHOGI_TRACE_SCOPE(name, arg) ((void)0)
+#define SHOGI_TRACE_INSTANT(name, arg) ((void)0)
+#define SHOGI_TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif
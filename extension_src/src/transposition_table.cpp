@@ -0,0 +1,87 @@
+#include "transposition_table.hpp"
+#include "trace.hpp"
+
+TranspositionTable::TranspositionTable(int size_mb) { resize(size_mb); }
+
+void TranspositionTable::resize(int size_mb) {
+    if (size_mb < 1) {
+        size_mb = 1;
+    }
+    SHOGI_TRACE_SCOPE("tt resize", size_mb);
+
+    // エントリ数は2の累乗に切り詰める
+    uint64_t count = (static_cast<uint64_t>(size_mb) << 20) / sizeof(Entry);
+    uint64_t power = 1;
+    while (power * 2 <= count) {
+        power *= 2;
+    }
+
+    entries.assign(power, Entry());
+    mask = power - 1;
+    clear();
+}
+
+void TranspositionTable::clear() {
+    SHOGI_TRACE_SCOPE("tt clear", static_cast<int64_t>(entries.size()));
+    for (Entry &entry : entries) {
+        entry = Entry{0, 0, 0, 0, BOUND_NONE};
+    }
+    generation = 0;
+}
+
+void TranspositionTable::new_search() { generation = (generation + 1) & 0x3F; }
+
+void TranspositionTable::set_isolated(bool enabled) {
+    isolated = enabled;
+    clear();
+}
+
+void TranspositionTable::new_task() {
+    new_search();
+    if (generation == 0) {
+        clear();
+    }
+}
+
+int TranspositionTable::get_size_mb() const { return static_cast<int>((entries.size() * sizeof(Entry)) >> 20); }
+
+bool TranspositionTable::probe(uint64_t key, Entry &entry) const {
+    const Entry &slot = entries[key & mask];
+    if (slot.key != key || !is_live(slot)) {
+        return false;
+    }
+
+    entry = slot;
+    return true;
+}
+
+void TranspositionTable::store(uint64_t key, int score, Bound bound, int depth, uint16_t move) {
+    Entry &slot = entries[key & mask];
+
+    // 同じ局面なら深い結果を優先し、別の局面なら古い世代か浅い結果を置き換える
+    bool live = is_live(slot);
+    if (live && slot.key == key) {
+        if (depth < slot.depth && bound != BOUND_EXACT) {
+            return;
+        }
+        if (move == 0) {
+            move = slot.move;
+        }
+    } else if (live && slot.generation() == generation && depth < slot.depth) {
+        return;
+    }
+
+    slot.key = key;
+    slot.score = score;
+    slot.move = move;
+    slot.depth = static_cast<int8_t>(depth);
+    slot.bound_generation = static_cast<uint8_t>(bound | (generation << 2));
+}
+
+void TranspositionTable::collect(int min_depth, std::vector<Entry> &out) const {
+    for (const Entry &entry : entries) {
+        if (entry.bound() != BOUND_NONE && entry.depth >= min_depth) {
+            out.push_back(entry);
+        }
+    }
+}
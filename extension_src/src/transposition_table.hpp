@@ -0,0 +1,60 @@
+#ifndef TRANSPOSITION_TABLE_HPP
+#define TRANSPOSITION_TABLE_HPP
+
+#include <cstdint>
+#include <vector>
+
+// 置換表
+// 評価値は手番側から見た値で保存する
+class TranspositionTable {
+  public:
+    enum Bound : uint8_t { BOUND_NONE = 0, BOUND_UPPER = 1, BOUND_LOWER = 2, BOUND_EXACT = 3 };
+
+    struct Entry {
+        uint64_t key;
+        int32_t score;
+        uint16_t move;
+        int8_t depth;
+        uint8_t bound_generation; // 下位2ビットがBound、上位6ビットが世代
+
+        Bound bound() const { return static_cast<Bound>(bound_generation & 0x3); }
+        uint8_t generation() const { return bound_generation >> 2; }
+    };
+
+  private:
+    std::vector<Entry> entries;
+    uint64_t mask = 0;
+    uint8_t generation = 0;
+    bool isolated = false; // 今の世代のエントリだけを引く（new_task で表を消したのと同じになる）
+
+    bool is_live(const Entry &slot) const {
+        return slot.bound() != BOUND_NONE && (!isolated || slot.generation() == generation);
+    }
+
+  public:
+#ifdef __EMSCRIPTEN__
+    static const int DEFAULT_SIZE_MB = 4; // ブラウザではメモリを控えめにする
+#else
+    static const int DEFAULT_SIZE_MB = 16;
+#endif
+
+    explicit TranspositionTable(int size_mb = DEFAULT_SIZE_MB);
+
+    void resize(int size_mb);
+    void clear();
+    void new_search();
+    int get_size_mb() const;
+
+    // ルート分割のワーカー用。タスクごとに表を消す代わりに世代を進め、前の世代は空きとみなす
+    // （世代が一巡したときだけ実際に消すので、結果は毎回消した場合と変わらない）
+    void set_isolated(bool enabled);
+    void new_task();
+
+    // 見つかれば true を返し、entry に内容を書き込む
+    bool probe(uint64_t key, Entry &entry) const;
+    void store(uint64_t key, int score, Bound bound, int depth, uint16_t move);
+    // 残り深さが min_depth 以上のエントリを out に足す
+    void collect(int min_depth, std::vector<Entry> &out) const;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "zobrist.hpp"
+
+namespace {
+
+// 再現性のある乱数列（splitmix64）
+uint64_t next_random(uint64_t &state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+} // namespace
+
+namespace Zobrist {
+
+Table::Table() {
+    uint64_t state = 0x5265796F72616E00ULL;
+
+    for (int index = 0; index < Shogi::BOARD_SIZE; ++index) {
+        for (int side = 0; side < 2; ++side) {
+            for (int promoted = 0; promoted < 2; ++promoted) {
+                for (int piece_type = 0; piece_type < Shogi::PIECE_TYPE_COUNT; ++piece_type) {
+                    piece[index][side][promoted][piece_type] = next_random(state);
+                }
+            }
+        }
+    }
+
+    for (int s = 0; s < 2; ++s) {
+        for (int piece_type = 0; piece_type < Shogi::PIECE_TYPE_COUNT; ++piece_type) {
+            // 0枚のときは0にしておくと、持ち駒なしの局面で計算を省ける
+            hand[s][piece_type][0] = 0;
+            for (int count = 1; count <= HAND_MAX; ++count) {
+                hand[s][piece_type][count] = next_random(state);
+            }
+        }
+    }
+
+    side = next_random(state);
+}
+
+const Table TABLE;
+
+} // namespace Zobrist
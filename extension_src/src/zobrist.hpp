@@ -0,0 +1,38 @@
+#ifndef ZOBRIST_HPP
+#define ZOBRIST_HPP
+
+#include <cstdint>
+
+#include "shogi_utils.hpp"
+
+namespace Zobrist {
+
+// 持ち駒の最大枚数（歩18枚）
+const int HAND_MAX = 18;
+
+struct Table {
+    uint64_t piece[Shogi::BOARD_SIZE][2][2][Shogi::PIECE_TYPE_COUNT];
+    uint64_t hand[2][Shogi::PIECE_TYPE_COUNT][HAND_MAX + 1];
+    uint64_t side;
+
+    Table();
+};
+
+extern const Table TABLE;
+
+inline uint64_t piece_key(int index, int side, bool is_promoted, int piece_type) {
+    return TABLE.piece[index][side][is_promoted ? 1 : 0][piece_type];
+}
+
+inline uint64_t hand_key(int side, int piece_type, int count) {
+    if (count > HAND_MAX) {
+        count = HAND_MAX;
+    }
+    return TABLE.hand[side][piece_type][count];
+}
+
+inline uint64_t side_key() { return TABLE.side; }
+
+} // namespace Zobrist
+
+#endif
@@ -6,3 +6,8 @@ const BOARD_COLS = 9
 const BOARD_ROWS = 9
 const KANJI_NUMS = ["一", "二", "三", "四", "五", "六", "七", "八", "九"]
 const ARABIC_NUMS = ["１", "２", "３", "４", "５", "６", "７", "８", "９"]
+const NNUE_PATH = "res://assets/nnue/ryoran.nnue"
+# 過去の対局の探索結果（対局の終わりに書き出し、起動時に読み込む）
+const EXPERIENCE_PATH = "user://experience.bin"
+# AIの棋力（0〜20、20で最も強い）
+const AI_SKILL_LEVEL = 20
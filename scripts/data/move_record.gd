@@ -25,3 +25,17 @@ func _init(
 	from_row = _from_row
 	to_col = _to_col
 	to_row = _to_row
+
+
+# ShogiEngine に渡す指し手の形式に変換する
+func to_dictionary() -> Dictionary:
+	var is_drop = from_col == -1 and from_row == -1
+	return {
+		"from_col": 0 if is_drop else from_col,
+		"from_row": 0 if is_drop else from_row,
+		"to_col": to_col,
+		"to_row": to_row,
+		"piece_type": piece.piece_type,
+		"is_promotion": is_promotion,
+		"is_drop": is_drop,
+	}
@@ -27,6 +27,10 @@ var _ai_thread: Thread
 var _eval_engine: ShogiEngine = ShogiEngine.new()
 var _eval_thread: Thread
 var last_analyzed_turn: int = 0
+# スレッドが使えない環境（スレッドなしのWeb版）では探索をフレームごとに区切って進める
+const SEARCH_SLICE_USEC = 8000
+var _use_sliced_search: bool = not OS.has_feature("threads")
+var _is_eval_searching: bool = false
 
 
 # Called when the node enters the scene tree for the first time.
@@ -36,6 +40,13 @@ func _ready() -> void:
 	resign_button.pressed.connect(_on_resign_button_pressed)
 	
 	_shogi_engine.is_enemy_side = true
+	_shogi_engine.skill_level = GameConfig.AI_SKILL_LEVEL
+	_load_eval_network(_shogi_engine)
+	_load_eval_network(_eval_engine)
+	_load_experience(_shogi_engine)
+	_load_experience(_eval_engine)
+	# 書き出すのは対局するエンジンだけなので、解析用のエンジンでは集めない
+	_shogi_engine.experience_recording = true
 	
 	_reset_game()
 
@@ -48,6 +59,9 @@ func _process(_delta: float) -> void:
 	if is_ai_thinking:
 		return
 	
+	if _is_eval_searching:
+		return
+	
 	if _eval_thread != null:
 		if _eval_thread.is_alive():
 			return
@@ -67,6 +81,21 @@ func _process(_delta: float) -> void:
 		_start_background_analysis()
 
 
+func _load_eval_network(engine: ShogiEngine) -> void:
+	if not FileAccess.file_exists(GameConfig.NNUE_PATH):
+		return
+	
+	if engine.load_eval_network(GameConfig.NNUE_PATH):
+		engine.eval_backend = ShogiEngine.EVAL_NNUE
+
+
+func _load_experience(engine: ShogiEngine) -> void:
+	if not FileAccess.file_exists(GameConfig.EXPERIENCE_PATH):
+		return
+	
+	engine.load_experience(GameConfig.EXPERIENCE_PATH)
+
+
 func _on_new_game_button_pressed() -> void:
 	var result = await request_new_game_decision()
 	if not result:
@@ -130,6 +159,8 @@ func _reset_game() -> void:
 	_update_turn_display()
 	win_rate_bar.reset_bar(true)
 	board.setup_starting_board(self)
+	_shogi_engine.new_game()
+	_eval_engine.new_game()
 	move_history_panel.clear()
 	move_history_panel.add_game_start(current_turn)
 	check_label.cancel_animation()
@@ -205,6 +236,7 @@ func _finish_turn(piece: Piece) -> void:
 	var record = move_history.back()
 	var prev_record = move_history[-2] if move_history.size() >= 2 else null
 	move_history_panel.add_move(current_turn, record, prev_record)
+	_push_engine_move(record)
 	
 	var target_is_enemy = current_turn % 2 != 0
 	if ShogiEngine.is_king_in_check(self, target_is_enemy):
@@ -233,21 +265,33 @@ func _play_ai_turn() -> void:
 	is_ai_thinking = true
 	_update_button_states()
 
-	_shogi_engine.update_state(self)
+	if _use_sliced_search:
+		_apply_next_move(await _search_in_slices(_shogi_engine))
+		return
 	
+	# 局面はメインスレッドで写してから、読むのだけを別スレッドで行う
+	_shogi_engine.begin_search()
 	_ai_thread = Thread.new()
 	_ai_thread.start(_calculate_next_move)
 
 
 func _start_background_analysis() -> void:
-	_eval_engine.update_state(self)
+	_eval_engine.is_enemy_side = false
+	if _use_sliced_search:
+		_is_eval_searching = true
+		var move = await _search_in_slices(_eval_engine)
+		_is_eval_searching = false
+		_on_background_analysis_completed(move)
+		return
+	
+	_eval_engine.begin_search()
 	_eval_thread = Thread.new()
 	_eval_thread.start(_run_background_analysis)
 
 
 func _run_background_analysis() -> void:
-	_eval_engine.is_enemy_side = false
-	var move = _eval_engine.search_best_move()
+	_eval_engine.continue_search(0)
+	var move = _eval_engine.get_search_result()
 	call_deferred("_on_background_analysis_completed", move)
 
 
@@ -259,14 +303,29 @@ func _on_background_analysis_completed(move: Dictionary) -> void:
 	win_rate_bar.update_bar(move.win_rate)
 
 
+func _search_in_slices(engine: ShogiEngine) -> Dictionary:
+	engine.begin_search()
+	while not engine.continue_search(SEARCH_SLICE_USEC):
+		await get_tree().process_frame
+	return engine.get_search_result()
+
+
 func _calculate_next_move() -> void:
-	var move = _shogi_engine.search_best_move()
+	_shogi_engine.continue_search(0)
+	var move = _shogi_engine.get_search_result()
 	call_deferred("_apply_next_move", move)
 
 
 func _apply_next_move(move: Dictionary) -> void:
-	_ai_thread.wait_to_finish()
-	_ai_thread = null
+	if _ai_thread != null:
+		_ai_thread.wait_to_finish()
+		_ai_thread = null
+	
+	# 入玉宣言かどうか（宣言した側の勝ち）
+	if move.get("declare_win", false):
+		await _finish_game(not _shogi_engine.is_enemy_side, true)
+		is_ai_thinking = false
+		return
 	
 	# 投了かどうか
 	if move.is_empty():
@@ -301,11 +360,16 @@ func _apply_next_move(move: Dictionary) -> void:
 	_finish_turn(piece)
 
 
-func _finish_game(is_player_win: bool) -> void:
+func _finish_game(is_player_win: bool, is_declaration := false) -> void:
 	current_turn += 1
 	_update_turn_display()
-	move_history_panel.add_resignation(current_turn)
+	if is_declaration:
+		move_history_panel.add_declaration(current_turn)
+	else:
+		move_history_panel.add_resignation(current_turn)
 	check_label.cancel_animation()
+	# 書き出しは別スレッドで進むので、結果の表示は待たせない
+	_shogi_engine.save_experience(GameConfig.EXPERIENCE_PATH)
 	await show_game_result(current_turn - 1, is_player_win)
 	is_game_active = false
 	
@@ -386,6 +450,10 @@ func _handle_promotion(piece: Piece, prev_row: int, current_row: int, move_recor
 	if is_in_zone:
 		piece.is_held = false
 		
+		# 行き所のない駒は必ず成る
+		if mode == PromotionMode.Type.ASK_USER and _is_dead_end(piece, current_row):
+			mode = PromotionMode.Type.FORCE_PROMOTE
+		
 		var should_promote = false
 		match mode:
 			PromotionMode.Type.ASK_USER:
@@ -400,6 +468,16 @@ func _handle_promotion(piece: Piece, prev_row: int, current_row: int, move_recor
 			move_record.is_promotion = true
 
 
+func _is_dead_end(piece: Piece, row: int) -> bool:
+	var relative_row = GameConfig.BOARD_ROWS - 1 - row if piece.is_enemy else row
+	match piece.piece_type:
+		Piece.Type.PAWN, Piece.Type.LANCE:
+			return relative_row == 0
+		Piece.Type.KNIGHT:
+			return relative_row <= 1
+	return false
+
+
 func _undo_last_move() -> void:
 	if move_history.is_empty():
 		return
@@ -457,6 +535,8 @@ func _undo_last_move() -> void:
 	
 	current_turn -= 1
 	is_game_active = true
+	_shogi_engine.pop_move()
+	_eval_engine.pop_move()
 	_update_last_move_highlight()
 	_update_turn_display()
 	_update_button_states()
@@ -464,6 +544,13 @@ func _undo_last_move() -> void:
 	check_label.cancel_animation()
 
 
+# エンジンは自分で盤面を持つので、シーンから読み直さずに指し手だけを渡す
+func _push_engine_move(record: MoveRecord) -> void:
+	var move = record.to_dictionary()
+	_shogi_engine.push_move(move)
+	_eval_engine.push_move(move)
+
+
 func _update_last_move_highlight() -> void:
 	if move_history.is_empty():
 		board.clear_last_move_highlight()
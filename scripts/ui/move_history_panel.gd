@@ -16,6 +16,13 @@ func add_resignation(current_turn: int) -> void:
 	_append_entry_row(current_turn, move_text)
 
 
+func add_declaration(current_turn: int) -> void:
+	var is_player_turn = (current_turn - 1) % 2 == 0
+	var marker = "▲" if is_player_turn else "△"
+	var move_text = "%s入玉宣言" % marker
+	_append_entry_row(current_turn, move_text)
+
+
 func add_move(current_turn: int, record: MoveRecord, prev_record: MoveRecord) -> void:
 	var move_text = _format_move_notation(current_turn, record, prev_record)
 	_append_entry_row(current_turn, move_text)
@@ -0,0 +1,14 @@
+extends RefCounted
+## tools/*.gd で共有するコマンドライン引数の読み取り
+##
+## `-- --key=value --flag` を Dictionary にする（値は文字列、値のないフラグは "true"）。
+
+
+static func parse(user_args: PackedStringArray) -> Dictionary:
+	var args := {}
+	for arg in user_args:
+		if not arg.begins_with("--"):
+			continue
+		var pair := arg.substr(2).split("=", true, 1)
+		args[pair[0]] = pair[1] if pair.size() > 1 else "true"
+	return args
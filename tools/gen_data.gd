@@ -0,0 +1,47 @@
+extends SceneTree
+## 自己対局による学習データの生成（ヘッドレス実行用）
+##
+## 例:
+##   godot --headless --script res://tools/gen_data.gd -- --output=train.bin --positions=1000000 --depth=2
+##
+## 1局面40バイト（局面32バイト + 評価値・最善手・手数・結果）をヘッダなしで並べたファイルを書く。
+## 局面はスレッドごとに混ぜてから書き足すので、そのまま tools/tune_eval.gd の --data に渡せる。
+##
+## オプション:
+##   --output=PATH --positions=N --threads=N --seed=N
+##   --depth=N --nodes=N --hash=MB --random-plies=N --max-plies=N --eval-limit=N --network=PATH
+
+
+const CliArgs = preload("res://tools/cli_args.gd")
+
+
+func _init() -> void:
+	var args := CliArgs.parse(OS.get_cmdline_user_args())
+	if not args.has("output"):
+		printerr("--output is required")
+		quit(1)
+		return
+
+	var config := {}
+	for key in ["depth", "nodes", "random-plies", "max-plies", "eval-limit"]:
+		if args.has(key):
+			config[key.replace("-", "_")] = int(args[key])
+	if args.has("hash"):
+		config["hash_mb"] = int(args["hash"])
+	if args.has("network"):
+		config["eval_network"] = args["network"]
+
+	var generator := DataGenerator.new()
+	if not generator.configure(config):
+		quit(1)
+		return
+
+	var result: Dictionary = generator.generate(args["output"], int(args.get("positions", "100000")),
+			int(args.get("threads", "0")), int(args.get("seed", "0")))
+	if result.is_empty():
+		quit(1)
+		return
+
+	print("Wrote %d positions from %d games to %s" % [result["positions"], result["games"], args["output"]])
+	print("%d positions/sec with %d threads" % [result["positions_per_sec"], result["threads"]])
+	quit(0)
@@ -0,0 +1,141 @@
+extends SceneTree
+## エンジンの基本操作のマイクロベンチマーク（ヘッドレス実行用）
+##
+## 例:
+##   godot --headless --script res://tools/microbench.gd -- --samples=500 --output=microbench.json
+##   godot --headless --script res://tools/microbench.gd -- --baseline=microbench.json
+##
+## 操作ごとに 1回あたりの ns の中央値と分位点を出す。シーンから読む操作（init_from_main と
+## Variant 経由の get("piece_type")）は、main.gd と同じプロパティを持つ仮のノードで測る。
+##
+## オプション:
+##   --samples=N --output=PATH --baseline=PATH --threshold=PERCENT
+
+
+const CliArgs = preload("res://tools/cli_args.gd")
+const BOARD_COLS = 9
+const BOARD_ROWS = 9
+
+const MOCK_MAIN_SOURCE = """extends Node2D
+var board_grid = []
+var player_piece_stand: Node
+var enemy_piece_stand: Node
+var current_turn = 0
+"""
+
+const MOCK_PIECE_SOURCE = """extends Node
+var piece_type = 0
+var is_enemy = false
+var is_promoted = false
+"""
+
+
+func _init() -> void:
+	var args := CliArgs.parse(OS.get_cmdline_user_args())
+	var main_node := _build_mock_main()
+
+	var result: Dictionary = ShogiEngine.microbench(int(args.get("samples", "200")), main_node)
+	main_node.free()
+	_print_result(result)
+
+	var exit_code := 0
+	if args.has("baseline"):
+		exit_code = _compare_baseline(result, args["baseline"], float(args.get("threshold", "10")))
+
+	if args.has("output"):
+		var file := FileAccess.open(args["output"], FileAccess.WRITE)
+		if file == null:
+			printerr("Cannot write ", args["output"])
+			quit(1)
+			return
+		file.store_string(JSON.stringify(result, "\t"))
+		print("Wrote ", args["output"])
+
+	quit(exit_code)
+
+
+# 平手の開始局面を並べた仮の main ノード（board.gd の setup_starting_board と同じ配置）
+func _build_mock_main() -> Node2D:
+	var main_script := GDScript.new()
+	main_script.source_code = MOCK_MAIN_SOURCE
+	main_script.reload()
+	var piece_script := GDScript.new()
+	piece_script.source_code = MOCK_PIECE_SOURCE
+	piece_script.reload()
+
+	var main_node := Node2D.new()
+	main_node.set_script(main_script)
+	for stand_name in ["player_piece_stand", "enemy_piece_stand"]:
+		var stand := Node.new()
+		main_node.add_child(stand)
+		main_node.set(stand_name, stand)
+
+	var grid := []
+	for col in BOARD_COLS:
+		var column := []
+		column.resize(BOARD_ROWS)
+		grid.append(column)
+
+	var back_rank := [Piece.Type.LANCE, Piece.Type.KNIGHT, Piece.Type.SILVER, Piece.Type.GOLD, Piece.Type.KING,
+			Piece.Type.GOLD, Piece.Type.SILVER, Piece.Type.KNIGHT, Piece.Type.LANCE]
+	for col in BOARD_COLS:
+		_place(main_node, grid, piece_script, col, 6, Piece.Type.PAWN, false)
+		_place(main_node, grid, piece_script, BOARD_COLS - 1 - col, 2, Piece.Type.PAWN, true)
+		_place(main_node, grid, piece_script, col, 8, back_rank[col], false)
+		_place(main_node, grid, piece_script, BOARD_COLS - 1 - col, 0, back_rank[col], true)
+	_place(main_node, grid, piece_script, 1, 7, Piece.Type.BISHOP, false)
+	_place(main_node, grid, piece_script, 7, 7, Piece.Type.ROOK, false)
+	_place(main_node, grid, piece_script, 7, 1, Piece.Type.BISHOP, true)
+	_place(main_node, grid, piece_script, 1, 1, Piece.Type.ROOK, true)
+
+	main_node.set("board_grid", grid)
+	return main_node
+
+
+func _place(main_node: Node, grid: Array, piece_script: GDScript, col: int, row: int, type: int,
+		is_enemy: bool) -> void:
+	var piece := Node.new()
+	piece.set_script(piece_script)
+	piece.set("piece_type", type)
+	piece.set("is_enemy", is_enemy)
+	main_node.add_child(piece)
+	grid[col][row] = piece
+
+
+func _print_result(result: Dictionary) -> void:
+	print("%-24s %10s %10s %10s %10s" % ["primitive", "median ns", "p10", "p90", "p99"])
+	var primitives: Dictionary = result["primitives"]
+	for name in primitives:
+		var stats: Dictionary = primitives[name]
+		print("%-24s %10.1f %10.1f %10.1f %10.1f" % [name, stats["median_ns"], stats["p10_ns"], stats["p90_ns"],
+				stats["p99_ns"]])
+
+
+# 中央値が threshold % より遅くなった操作があれば 1 を返す
+func _compare_baseline(result: Dictionary, path: String, threshold: float) -> int:
+	if not FileAccess.file_exists(path):
+		printerr("Baseline not found: ", path)
+		return 1
+
+	var baseline = JSON.parse_string(FileAccess.get_file_as_string(path))
+	if not baseline is Dictionary or not baseline.has("primitives"):
+		printerr("Invalid baseline: ", path)
+		return 1
+
+	print("")
+	print("%-24s %10s %10s %8s" % ["primitive", "baseline", "now", "change"])
+	var regressed := false
+	var primitives: Dictionary = result["primitives"]
+	for name in primitives:
+		if not baseline["primitives"].has(name):
+			continue
+		var before: float = baseline["primitives"][name]["median_ns"]
+		var after: float = primitives[name]["median_ns"]
+		var change := (after - before) / before * 100.0 if before > 0.0 else 0.0
+		var mark := ""
+		if change > threshold:
+			mark = "  REGRESSION"
+			regressed = true
+		print("%-24s %10.1f %10.1f %+7.1f%%%s" % [name, before, after, change, mark])
+
+	return 1 if regressed else 0
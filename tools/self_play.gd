@@ -0,0 +1,61 @@
+extends SceneTree
+## エンジン同士の自己対局（ヘッドレス実行用）
+##
+## 例:
+##   godot --headless --script res://tools/self_play.gd -- --games=2000 --nodes-a=200000 --nodes-b=100000
+##
+## オプション（A/B それぞれに -a / -b を付ける）:
+##   --nodes-a=N --time-a=MSEC --depth-a=N --hash-a=MB --network-a=PATH
+##   --games=N --threads=N --openings=PATH --max-plies=N
+##   --elo0=E --elo1=E --alpha=P --beta=P
+
+
+const CliArgs = preload("res://tools/cli_args.gd")
+
+
+func _init() -> void:
+	var args := CliArgs.parse(OS.get_cmdline_user_args())
+	var runner := MatchRunner.new()
+
+	for i in 2:
+		var suffix := "a" if i == 0 else "b"
+		var config := {"name": suffix.to_upper()}
+		if args.has("nodes-" + suffix):
+			config["nodes"] = int(args["nodes-" + suffix])
+		if args.has("time-" + suffix):
+			config["time_msec"] = int(args["time-" + suffix])
+		if args.has("depth-" + suffix):
+			config["depth"] = int(args["depth-" + suffix])
+		if args.has("hash-" + suffix):
+			config["hash_mb"] = int(args["hash-" + suffix])
+		if args.has("network-" + suffix):
+			config["eval_network"] = args["network-" + suffix]
+		if not runner.configure_engine(i, config):
+			printerr("Failed to configure engine ", suffix.to_upper())
+			quit(1)
+			return
+
+	if args.has("openings"):
+		if runner.load_openings(args["openings"]) == 0:
+			quit(1)
+			return
+
+	if args.has("max-plies"):
+		runner.set_max_plies(int(args["max-plies"]))
+
+	runner.set_sprt(float(args.get("elo0", "0")), float(args.get("elo1", "5")),
+			float(args.get("alpha", "0.05")), float(args.get("beta", "0.05")))
+
+	var result: Dictionary = runner.run(int(args.get("games", "1000")), int(args.get("threads", "0")))
+	_print_result(result)
+	quit(0)
+
+
+func _print_result(result: Dictionary) -> void:
+	print("")
+	print("Games: %d  (+%d =%d -%d)  average plies %.1f" % [result["games"], result["wins"],
+			result["draws"], result["losses"], result["average_plies"]])
+	print("Elo: %.1f +/- %.1f  LLR %.2f  SPRT %s" % [result["elo"], result["elo_error"], result["llr"],
+			result["sprt"] if result["sprt"] != "" else "undecided"])
+	for stats in result["engines"]:
+		print("%s: %d nps, average depth %.2f" % [stats["name"], stats["nps"], stats["average_depth"]])
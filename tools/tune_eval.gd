@@ -0,0 +1,45 @@
+extends SceneTree
+## 駒得評価のパラメータ調整（ヘッドレス実行用）
+##
+## 例:
+##   godot --headless --script res://tools/tune_eval.gd -- --data=positions.txt --epochs=200
+##
+## 局面ファイルは1行に「SFEN 結果」（結果は先手から見た 1 / 0.5 / 0）。
+## 拡張子が .bin のファイルは tools/gen_data.gd で作った学習データとして読む。
+## 調整後の値で extension_src/src/eval_params.hpp を書き換える。
+##
+## オプション:
+##   --data=PATH[,PATH...] --epochs=N --threads=N --learning-rate=R --output=PATH
+
+
+const CliArgs = preload("res://tools/cli_args.gd")
+const DEFAULT_OUTPUT = "res://extension_src/src/eval_params.hpp"
+
+
+func _init() -> void:
+	var args := CliArgs.parse(OS.get_cmdline_user_args())
+	if not args.has("data"):
+		printerr("--data is required")
+		quit(1)
+		return
+
+	var tuner := EvalTuner.new()
+	for path in args["data"].split(","):
+		var count := tuner.load_positions(path)
+		print("Loaded %d positions from %s" % [count, path])
+
+	if tuner.get_position_count() == 0:
+		quit(1)
+		return
+
+	var result: Dictionary = tuner.tune(int(args.get("epochs", "200")), int(args.get("threads", "0")),
+			float(args.get("learning-rate", "2.0")))
+	print("Loss: %.6f -> %.6f" % [result["loss_before"], result["loss_after"]])
+	print(result["params"])
+
+	var output: String = args.get("output", DEFAULT_OUTPUT)
+	if not tuner.write_header(output):
+		quit(1)
+		return
+	print("Wrote ", output)
+	quit(0)